@@ -0,0 +1,169 @@
+﻿#include "ArchSignature.h"
+
+#include <algorithm>
+#include <bit>
+
+ArchSignature::ArchSignature(std::initializer_list<ComponentID> Components)
+{
+    for (auto Component : Components)
+    {
+        Add(Component);
+    }
+}
+
+void ArchSignature::Add(ComponentID Component)
+{
+    size_t Word = static_cast<size_t>(Component) / 64;
+    const uint64_t Mask = uint64_t(1) << (Component % 64);
+    if (Word < InlineWords)
+    {
+        Inline[Word] |= Mask;
+        return;
+    }
+    Word -= InlineWords;
+    if (Word >= Overflow.size())
+    {
+        Overflow.resize(Word + 1, 0);
+    }
+    Overflow[Word] |= Mask;
+}
+
+void ArchSignature::Remove(ComponentID Component)
+{
+    size_t Word = static_cast<size_t>(Component) / 64;
+    const uint64_t Mask = uint64_t(1) << (Component % 64);
+    if (Word < InlineWords)
+    {
+        Inline[Word] &= ~Mask;
+        return;
+    }
+    Word -= InlineWords;
+    if (Word >= Overflow.size())
+    {
+        return;
+    }
+    Overflow[Word] &= ~Mask;
+    while (!Overflow.empty() && Overflow.back() == 0)
+    {
+        Overflow.pop_back();
+    }
+}
+
+bool ArchSignature::ContainsAll(const ArchSignature& Other) const
+{
+    if (Other.Overflow.size() > Overflow.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < Other.WordCount(); i++)
+    {
+        const uint64_t Wanted = Other.GetWord(i);
+        if ((GetWord(i) & Wanted) != Wanted)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArchSignature::Intersects(const ArchSignature& Other) const
+{
+    const size_t Words = std::min(WordCount(), Other.WordCount());
+    for (size_t i = 0; i < Words; i++)
+    {
+        if ((GetWord(i) & Other.GetWord(i)) != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ArchSignature::IsEmpty() const
+{
+    for (size_t i = 0; i < InlineWords; i++)
+    {
+        if (Inline[i] != 0)
+        {
+            return false;
+        }
+    }
+    return Overflow.empty();
+}
+
+size_t ArchSignature::Count() const
+{
+    size_t Total = 0;
+    for (size_t i = 0; i < WordCount(); i++)
+    {
+        Total += std::popcount(GetWord(i));
+    }
+    return Total;
+}
+
+size_t ArchSignature::Hash() const
+{
+    // Mixes each word with the murmur3 finalizer instead of xoring IDs, which made sets cancel out
+    uint64_t Result = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < WordCount(); i++)
+    {
+        uint64_t Key = GetWord(i) + 0x9E3779B97F4A7C15ull * (i + 1);
+        Key ^= Key >> 33;
+        Key *= 0xFF51AFD7ED558CCDull;
+        Key ^= Key >> 33;
+        Key *= 0xC4CEB9FE1A85EC53ull;
+        Key ^= Key >> 33;
+        Result = (Result ^ Key) * 0x100000001B3ull;
+    }
+    return static_cast<size_t>(Result);
+}
+
+bool ArchSignature::operator==(const ArchSignature& Other) const
+{
+    for (size_t i = 0; i < InlineWords; i++)
+    {
+        if (Inline[i] != Other.Inline[i])
+        {
+            return false;
+        }
+    }
+    return Overflow == Other.Overflow;
+}
+
+ArchSignature::Iterator::Iterator(const ArchSignature* Owner, size_t Bit): Owner(Owner), Bit(Bit)
+{
+    SkipToSet();
+}
+
+ArchSignature::Iterator& ArchSignature::Iterator::operator++()
+{
+    Bit++;
+    SkipToSet();
+    return *this;
+}
+
+void ArchSignature::Iterator::SkipToSet()
+{
+    const size_t End = Owner->WordCount() * 64;
+    while (Bit < End)
+    {
+        const uint64_t Remaining = Owner->GetWord(Bit / 64) >> (Bit % 64);
+        if (Remaining != 0)
+        {
+            Bit += std::countr_zero(Remaining);
+            return;
+        }
+        Bit = (Bit / 64 + 1) * 64;
+    }
+    Bit = End;
+}
+
+ArchSignature::Iterator ArchSignature::begin() const
+{
+    return Iterator(this, 0);
+}
+
+ArchSignature::Iterator ArchSignature::end() const
+{
+    return Iterator(this, WordCount() * 64);
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "Types.h"
+
+// Set of component IDs stored as a bitset. The first InlineBits components live inline so copying, comparing
+// and hashing a signature never allocates, IDs past that spill into a heap allocated tail.
+// The tail never ends in a zero word so equal sets always compare and hash equal.
+class ArchSignature
+{
+public:
+    static constexpr size_t InlineWords = 2;
+    static constexpr size_t InlineBits = InlineWords * 64;
+
+    ArchSignature() = default;
+    ArchSignature(std::initializer_list<ComponentID> Components);
+
+    bool Contains(ComponentID Component) const
+    {
+        const size_t Word = static_cast<size_t>(Component) / 64;
+        return (GetWord(Word) >> (Component % 64) & 1) != 0;
+    }
+
+    void Add(ComponentID Component);
+    void Remove(ComponentID Component);
+
+    // True if every component of Other is also in this signature
+    bool ContainsAll(const ArchSignature& Other) const;
+    bool Intersects(const ArchSignature& Other) const;
+
+    bool IsEmpty() const;
+    size_t Count() const;
+    size_t Hash() const;
+
+    bool operator==(const ArchSignature& Other) const;
+    bool operator!=(const ArchSignature& Other) const { return !(*this == Other); }
+
+    // Walks the set components in ascending order
+    class Iterator
+    {
+    public:
+        Iterator(const ArchSignature* Owner, size_t Bit);
+
+        ComponentID operator*() const { return static_cast<ComponentID>(Bit); }
+        Iterator& operator++();
+        bool operator!=(const Iterator& Other) const { return Bit != Other.Bit; }
+
+    private:
+        void SkipToSet();
+
+        const ArchSignature* Owner;
+        size_t Bit;
+    };
+
+    Iterator begin() const;
+    Iterator end() const;
+
+private:
+    uint64_t GetWord(size_t Word) const
+    {
+        if (Word < InlineWords)
+        {
+            return Inline[Word];
+        }
+        Word -= InlineWords;
+        return Word < Overflow.size() ? Overflow[Word] : 0;
+    }
+    size_t WordCount() const { return InlineWords + Overflow.size(); }
+
+    uint64_t Inline[InlineWords] = {};
+    std::vector<uint64_t> Overflow;
+};
+
+namespace std
+{
+    template<> struct hash<ArchSignature>
+    {
+        std::size_t operator()(ArchSignature const& s) const noexcept
+        {
+            return s.Hash();
+        }
+    };
+}
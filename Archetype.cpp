@@ -2,123 +2,217 @@
 #include "Types.h"
 #include "Archetype.h"
 #include "ErrorHandling.h"
+#include "Tracing.h"
 int NextArchID()
 {
     static int NextID = 1;
     return NextID++;
 }
-Archetype::Archetype(): ID(NextArchID()), Signature({})
+Archetype::Archetype(): Archetype(ArchSignature())
 {
-    EntityIDStorage = new VectorStorage<EntityID>();
 }
 
-Archetype::Archetype(const ArchSignature& Base): ID(NextArchID()) 
+Archetype::Archetype(const ArchSignature& Base, size_t ChunkBytes, std::pmr::memory_resource* Resource):
+    ID(NextArchID()),
+    Allocator(Resource),
+    CmpToStoreIndex(Resource),
+    ColumnInfos(Resource),
+    Pairs(Resource),
+    Layout{0, 0, std::pmr::vector<size_t>(Resource)},
+    Chunks(Resource),
+    Edges(Resource)
 {
-    EntityIDStorage = new VectorStorage<EntityID>();
     for(const auto Type : Base)
     {
-        Signature.emplace(Type);
-        CmpToStoreIndex.emplace(Type, CmpStorage.size());
-        CmpStorage.push_back(MakeStorageForID(Type));
+        Signature.Add(Type);
+        const ComponentInfo& Info = GetComponentInfo(Type);
+        if (Info.Relation != InvalidComponentID)
+        {
+            Pairs.emplace_back(Info.Relation, Info.Target);
+        }
+        // Tags only live in the signature
+        if (Info.Tag)
+        {
+            continue;
+        }
+        if (static_cast<size_t>(Type) >= CmpToStoreIndex.size())
+        {
+            CmpToStoreIndex.resize(Type + 1, -1);
+        }
+        CmpToStoreIndex[Type] = static_cast<int>(ColumnInfos.size());
+        ColumnInfos.push_back(&Info);
     }
+
+    if (ChunkBytes == 0)
+    {
+        // Unchunked archetypes keep a single chunk of growing columns for their whole life
+        Chunks.push_back(Allocator.new_object<ArchetypeChunk>(ColumnInfos, Layout, Resource));
+        return;
+    }
+    Layout = ChunkLayout::Compute(ColumnInfos, ChunkBytes);
+    RowsPerChunk = Layout.Capacity;
 }
 
 Archetype::~Archetype()
 {
-    delete EntityIDStorage;
-    for (auto Store : CmpStorage)
+    for (auto Chunk : Chunks)
     {
-        delete Store;
+        Allocator.delete_object(Chunk);
     }
 }
 
-void Archetype::CopyEntity(const EntityID& Entity, const Archetype* Source, ComponentID AddedType, const void* AddedValue)
+size_t Archetype::CopyEntity(const EntityID& Entity, Archetype* Source, size_t SourceRow, ComponentID AddedType,
+    const void* AddedValue, ChangeTick Tick)
 {
-    Trace("Copy Entity %d from %d to %d\n", Entity, Source == nullptr? -1 : Source->ID, this->ID);
+    ECS_TRACE_INSTANT("Move entity", this->ID);
     if(this == Source)
     {
         Error("Tried to copy entity into same archetype\n");
     }
+    if(AddedType != InvalidComponentID && !Signature.Contains(AddedType))
+    {
+        Error("Added type %d not present in destination\n", AddedType);
+    }
     
-    auto FoundEntity = EntityToIndex.find(Entity);
-    if (FoundEntity != EntityToIndex.end())
+    ArchetypeChunk* Chunk = GetChunkForAppend();
+    Chunk->GetEntityColumn()->AddCopy(&Entity);
+    Idle = false;
+    Chunk->MarkPlaced(Tick);
+
+    size_t SourceLocal = 0;
+    ArchetypeChunk* SourceChunk = Source == nullptr ? nullptr : Source->FindChunk(SourceRow, SourceLocal);
+    const size_t SourceColumns = Source == nullptr ? 0 : Source->ColumnInfos.size();
+    // Both column lists are sorted by component ID, so the matching source column is found by walking
+    // them side by side
+    size_t SourceIndex = 0;
+    for (size_t i = 0; i < ColumnInfos.size(); i++)
     {
-        Error("Attempt to add already present entity %d\n", Entity);
+        Column* Store = Chunk->GetColumn(i);
+        if(ColumnInfos[i]->ID == AddedType)
+        {
+            Store->AddCopy(AddedValue);
+            Chunk->MarkAdded(i, Tick);
+            continue;
+        }
+        while (SourceIndex < SourceColumns && Source->ColumnInfos[SourceIndex]->ID < ColumnInfos[i]->ID)
+        {
+            SourceIndex++;
+        }
+        if (SourceIndex < SourceColumns && Source->ColumnInfos[SourceIndex]->ID == ColumnInfos[i]->ID)
+        {
+            Store->AddMoved(*SourceChunk->GetColumn(SourceIndex), SourceLocal);
+            Chunk->MarkMoved(i, *SourceChunk, SourceIndex);
+        }
+        else
+        {
+            Store->AddDefault(1);
+            Chunk->MarkAdded(i, Tick);
+        }
     }
-    auto FoundNewType = CmpToStoreIndex.find(AddedType);
-    if(AddedType != 0 && FoundNewType == CmpToStoreIndex.end())
+    return RowCount++;
+}
+
+EntityID Archetype::FastDelete(size_t Row)
+{
+    if (Row >= RowCount)
     {
-        Error("Added type %d not present in destination\n", AddedType);
+        Error("Failed to find row to delete %zu\n", Row);
     }
-    
-    EntityToIndex.emplace(Entity, EntityIDStorage->GetSize());
-    EntityIDStorage->AddRawData(&Entity);
+    size_t Local;
+    ArchetypeChunk* Chunk = FindChunk(Row, Local);
+    ECS_TRACE_INSTANT("Delete row", this->ID);
 
-    if(AddedType > 0)
+    // The last row of the last chunk fills the hole, so every chunk but the last stays full
+    ArchetypeChunk* Last = Chunks.back();
+    const size_t LastLocal = Last->GetCount() - 1;
+    Chunk->GetEntityColumn()->ReplaceWithMoved(Local, *Last->GetEntityColumn(), LastLocal);
+    Last->GetEntityColumn()->PopBack();
+    for (size_t i = 0; i < ColumnInfos.size(); i++)
     {
-        CmpStorage[FoundNewType->second]->AddRawData(AddedValue);
+        Chunk->GetColumn(i)->ReplaceWithMoved(Local, *Last->GetColumn(i), LastLocal);
+        Last->GetColumn(i)->PopBack();
+        if (Chunk != Last)
+        {
+            Chunk->MarkMoved(i, *Last, i);
+        }
     }
-    
-    for (auto Store : CmpStorage)
+    if (Chunk != Last)
+    {
+        Chunk->MarkPlaced(Last->GetPlacedTick());
+    }
+    RowCount--;
+
+    if (RowsPerChunk != SIZE_MAX && Last->GetCount() == 0)
     {
-        if(Store->GetTypeID() == AddedType) continue;
-        
-        Store->AddRawData(Source->GetValue(Entity, Store->GetTypeID()));
+        Allocator.delete_object(Last);
+        Chunks.pop_back();
     }
+    //we moved the last entity into the hole, the caller needs to update its row
+    if (Row != RowCount)
+    {
+        return Chunk->GetEntityIDs()[Local];
+    }
+    return 0;
 }
 
-void Archetype::FastDelete(const EntityID& ID)
+size_t Archetype::AddEntities(const EntityID* IDs, size_t Count, ChangeTick Tick)
 {
-    Trace("Delete Entity %d from %d\n", ID, this->ID);
-    auto Found = EntityToIndex.find(ID);
-    if (Found == EntityToIndex.end())
+    return AddEntities(IDs, Count, Tick, [](Column& Store, size_t, size_t, size_t Rows)
     {
-        Error("Failed to find entity to delete %d\n", ID);
-    }
-    const int Index = Found->second;
+        Store.AddDefault(Rows);
+    });
+}
 
-    EntityToIndex.erase(ID);
-    EntityIDStorage->FastDelete(Index);
-    for (auto Store : CmpStorage)
+void Archetype::SetValue(size_t Row, const ComponentID& CmpID, const void* Data, ChangeTick Tick)
+{
+    if (Row >= RowCount)
     {
-        Store->FastDelete(Index);
+        Error("Failed to find row to set %zu\n", Row);
     }
-    //we swapped the entity ID, so we need to update the index
-    if (Index != EntityIDStorage->GetSize())
+    const int Index = GetColumnIndex(CmpID);
+    if (Index < 0 && Signature.Contains(CmpID))
     {
-        EntityID MovedID = *static_cast<EntityID*>(EntityIDStorage->GetRawData(Index));
-        EntityToIndex[MovedID] = Index;
+        // A tag, there is no value to write
+        return;
     }
+    if (Index < 0)
+    {
+        Error("Failed to find Component to set %d\n", CmpID);
+    }
+    size_t Local;
+    ArchetypeChunk* Chunk = FindChunk(Row, Local);
+    Chunk->GetColumn(Index)->Set(Local, Data);
+    Chunk->MarkChanged(Index, Tick);
 }
 
-void Archetype::SetValue(const EntityID& ID, const ComponentID& CmpID, const void* Data)
+void Archetype::MarkChanged(size_t Row, const ComponentID& CmpID, ChangeTick Tick)
 {
-    auto FoundEntity = EntityToIndex.find(ID);
-    if (FoundEntity == EntityToIndex.end())
+    const int Index = GetColumnIndex(CmpID);
+    if (Index < 0 && Signature.Contains(CmpID))
     {
-        Error("Failed to find entity to set %d\n", ID);
+        return;
     }
-    auto FoundCmp = CmpToStoreIndex.find(CmpID);
-    if (FoundCmp == CmpToStoreIndex.end())
+    if (Row >= RowCount || Index < 0)
     {
-        Error("Failed to find Component to set %d\n", CmpID);
+        Error("Failed to find Component to mark %d\n", CmpID);
     }
-    CmpStorage[FoundCmp->second]->SetRawData(FoundEntity->second, Data);
+    size_t Local;
+    FindChunk(Row, Local)->MarkChanged(Index, Tick);
 }
 
-void* Archetype::GetValue(const EntityID& ID, const ComponentID& CmpID) const 
+void* Archetype::GetValue(size_t Row, const ComponentID& CmpID) const 
 {
-    auto FoundEntity = EntityToIndex.find(ID);
-    if (FoundEntity == EntityToIndex.end())
+    if (Row >= RowCount)
     {
-        Error("Failed to find entity to set %d\n", ID);
+        Error("Failed to find row to get %zu\n", Row);
     }
-    auto FoundCmp = CmpToStoreIndex.find(CmpID);
-    if (FoundCmp == CmpToStoreIndex.end())
+    const int Index = GetColumnIndex(CmpID);
+    if (Index < 0)
     {
         Error("Failed to find Component to set %d\n", CmpID);
     }
-    return CmpStorage[FoundCmp->second]->GetRawData(FoundEntity->second);
+    size_t Local;
+    return FindChunk(Row, Local)->GetColumn(Index)->Get(Local);
 }
 
 const ArchSignature* Archetype::GetSignature() const
@@ -126,7 +220,127 @@ const ArchSignature* Archetype::GetSignature() const
     return &Signature;
 }
 
-VectorStorage<EntityID>* Archetype::GetEntityIDs() const
+EntityID Archetype::GetEntityID(size_t Row) const
+{
+    size_t Local;
+    return FindChunk(Row, Local)->GetEntityIDs()[Local];
+}
+
+size_t Archetype::GetEntityCount() const
+{
+    return RowCount;
+}
+
+int Archetype::GetColumnIndex(const ComponentID& CmpID) const
+{
+    if (CmpID < 0 || static_cast<size_t>(CmpID) >= CmpToStoreIndex.size())
+    {
+        return -1;
+    }
+    return CmpToStoreIndex[CmpID];
+}
+
+EntityID Archetype::GetTarget(ComponentID Relation) const
+{
+    for (const auto& Pair : Pairs)
+    {
+        if (Pair.first == Relation)
+        {
+            return Pair.second;
+        }
+    }
+    return 0;
+}
+
+Archetype* Archetype::GetAddEdge(const ComponentID& CmpID) const
+{
+    return static_cast<size_t>(CmpID) < Edges.size() ? Edges[CmpID].Add : nullptr;
+}
+
+Archetype* Archetype::GetRemoveEdge(const ComponentID& CmpID) const
+{
+    return static_cast<size_t>(CmpID) < Edges.size() ? Edges[CmpID].Remove : nullptr;
+}
+
+void Archetype::SetAddEdge(const ComponentID& CmpID, Archetype* Target)
+{
+    GetEdge(CmpID).Add = Target;
+}
+
+void Archetype::SetRemoveEdge(const ComponentID& CmpID, Archetype* Target)
+{
+    GetEdge(CmpID).Remove = Target;
+}
+
+Archetype::Edge& Archetype::GetEdge(const ComponentID& CmpID)
+{
+    if (static_cast<size_t>(CmpID) >= Edges.size())
+    {
+        Edges.resize(CmpID + 1);
+    }
+    return Edges[CmpID];
+}
+
+void Archetype::Unlink()
+{
+    for (size_t Type = 0; Type < Edges.size(); Type++)
+    {
+        const ComponentID CmpID = static_cast<ComponentID>(Type);
+        if (Edges[Type].Add != nullptr && Edges[Type].Add->GetRemoveEdge(CmpID) == this)
+        {
+            Edges[Type].Add->SetRemoveEdge(CmpID, nullptr);
+        }
+        if (Edges[Type].Remove != nullptr && Edges[Type].Remove->GetAddEdge(CmpID) == this)
+        {
+            Edges[Type].Remove->SetAddEdge(CmpID, nullptr);
+        }
+    }
+    Edges.clear();
+}
+
+size_t Archetype::ShrinkToFit()
+{
+    size_t Freed = 0;
+    for (auto Chunk : Chunks)
+    {
+        Freed += Chunk->ShrinkToFit();
+    }
+    const size_t Before = Chunks.capacity();
+    Chunks.shrink_to_fit();
+    return Freed + (Before - Chunks.capacity()) * sizeof(ArchetypeChunk*);
+}
+
+bool Archetype::MarkIdle()
+{
+    const bool Was = Idle;
+    Idle = true;
+    return Was;
+}
+
+size_t Archetype::GetAllocatedBytes() const
+{
+    size_t Bytes = sizeof(*this) + CmpToStoreIndex.capacity() * sizeof(int)
+        + ColumnInfos.capacity() * sizeof(const ComponentInfo*) + Pairs.capacity() * sizeof(Pairs[0])
+        + Layout.Offsets.capacity() * sizeof(size_t) + Chunks.capacity() * sizeof(ArchetypeChunk*)
+        + Edges.capacity() * sizeof(Edge);
+    for (auto Chunk : Chunks)
+    {
+        Bytes += Chunk->GetAllocatedBytes();
+    }
+    return Bytes;
+}
+
+ArchetypeChunk* Archetype::GetChunkForAppend()
+{
+    if (Chunks.empty() || Chunks.back()->IsFull())
+    {
+        Chunks.push_back(Allocator.new_object<ArchetypeChunk>(ColumnInfos, Layout, Allocator.resource()));
+    }
+    return Chunks.back();
+}
+
+ArchetypeChunk* Archetype::FindChunk(size_t Row, size_t& LocalRow) const
 {
-    return EntityIDStorage;
+    LocalRow = Row % RowsPerChunk;
+    return Chunks[Row / RowsPerChunk];
 }
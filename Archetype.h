@@ -1,69 +1,188 @@
 ﻿#pragma once
-#include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
 
+#include "ArchSignature.h"
+#include "ArchetypeChunk.h"
+#include "Column.h"
+#include "Component.h"
+#include "Tracing.h"
 #include "Types.h"
-#include "VectorStorage.h"
-
-// custom specialization of std::hash can be injected in namespace std
-namespace std
-{
-    template<> struct hash<ArchSignature>
-    {
-        std::size_t operator()(ArchSignature const& s) const noexcept
-        {
-            std::size_t hash = 0;
-            for (auto && i : s) hash ^= std::hash<ComponentID>()(i);
-            return hash;
-        }
-    };
-}
 
 class Archetype
 {
 public:
     explicit Archetype();
-    explicit Archetype(const ArchSignature& Base);
+    // ChunkBytes of 0 keeps every column in one growing buffer, otherwise rows are stored in fixed blocks of
+    // about that size which never move once allocated. All storage is taken from Resource
+    explicit Archetype(const ArchSignature& Base, size_t ChunkBytes = 0,
+        std::pmr::memory_resource* Resource = std::pmr::get_default_resource());
     Archetype(const Archetype& obj) = delete;
 
     ~Archetype();
 
-    void CopyEntity(const EntityID& Entity, const Archetype* Source, ComponentID AddedType, const void* AddedValue);
+    // Entities are addressed by row, the world keeps track of which row each entity lives in.
+    // Appends Entity moving its components out of SourceRow of Source. AddedType is copied from AddedValue and any
+    // other column Source lacks is value initialized, and those count as added at Tick. Returns the new row
+    size_t CopyEntity(const EntityID& Entity, Archetype* Source, size_t SourceRow, ComponentID AddedType,
+        const void* AddedValue, ChangeTick Tick);
 
-    void FastDelete(const EntityID& ID);
+    // Moves the last row into Row. Returns the entity now living at Row, or 0 if Row was the last one
+    EntityID FastDelete(size_t Row);
+
+    // Appends all entities at once with value initialized components added at Tick. Returns the row of the first one
+    size_t AddEntities(const EntityID* IDs, size_t Count, ChangeTick Tick);
+    // Same, but Fill(Store, ColumnIndex, FirstID, RowCount) appends the component rows for IDs[FirstID] onwards.
+    // It is called once per column for every chunk the entities land in
+    template<typename Func>
+    size_t AddEntities(const EntityID* IDs, size_t Count, ChangeTick Tick, const Func& Fill);
 
     template<typename T>
-    void SetValue(const EntityID& ID, const T& Data);
-    void SetValue(const EntityID& ID, const ComponentID& CmpID, const void* Data);
+    void SetValue(size_t Row, const T& Data, ChangeTick Tick);
+    void SetValue(size_t Row, const ComponentID& CmpID, const void* Data, ChangeTick Tick);
+    // For writes made through a pointer handed out by GetValue
+    void MarkChanged(size_t Row, const ComponentID& CmpID, ChangeTick Tick);
 
     template<typename T>
-    T* GetValue(const EntityID& ID);
-    void* GetValue(const EntityID& ID, const ComponentID& CmpID) const;
+    T* GetValue(size_t Row);
+    void* GetValue(size_t Row, const ComponentID& CmpID) const;
 
     const ArchSignature* GetSignature() const;
 
-    VectorStorage<EntityID>* GetEntityIDs() const;
+    EntityID GetEntityID(size_t Row) const;
+    size_t GetEntityCount() const;
+
+    // Position of the component in each chunk's column list, -1 if the archetype does not have it
+    int GetColumnIndex(const ComponentID& CmpID) const;
+
+    // Target of the relationship pair of Relation in the signature, 0 if there is none
+    EntityID GetTarget(ComponentID Relation) const;
+    // Relation and target of every pair in the signature
+    const std::pmr::vector<std::pair<ComponentID, EntityID>>& GetPairs() const { return Pairs; }
+
+    // Resolves the column for a component once per chunk so callers can walk it directly instead of per entity
+    // lookups
+    template<typename T>
+    T* GetColumnData(const ArchetypeChunk& Chunk) const;
+
+    size_t GetChunkCount() const { return Chunks.size(); }
+    ArchetypeChunk* GetChunk(size_t Index) const { return Chunks[Index]; }
+    // Rows held by every chunk but the last one, SIZE_MAX when the archetype is not chunked
+    size_t GetRowsPerChunk() const { return RowsPerChunk; }
+
+    // Calls Handler(Chunk, LocalBegin, LocalEnd) for every chunk overlapping rows [Begin, End)
+    template<typename Func>
+    void ForEachChunk(size_t Begin, size_t End, const Func& Handler) const;
+
+    // Cached neighbours in the archetype graph: where an entity of this archetype ends up when the component is
+    // added or removed. Null until the transition has been taken once
+    Archetype* GetAddEdge(const ComponentID& CmpID) const;
+    Archetype* GetRemoveEdge(const ComponentID& CmpID) const;
+    void SetAddEdge(const ComponentID& CmpID, Archetype* Target);
+    void SetRemoveEdge(const ComponentID& CmpID, Archetype* Target);
+    // Clears the edges of every neighbour leading here, before the archetype is destroyed. Edges are always set
+    // in pairs, so the neighbours are the ones this archetype has edges to
+    void Unlink();
+
+    // Trims storage kept from a past peak, returns the bytes freed
+    size_t ShrinkToFit();
+    // The archetype stays idle until rows are added to it. Returns whether it already was
+    bool MarkIdle();
+    // Everything the archetype holds from its resource
+    size_t GetAllocatedBytes() const;
 private:
+    struct Edge
+    {
+        Archetype* Add = nullptr;
+        Archetype* Remove = nullptr;
+    };
+    Edge& GetEdge(const ComponentID& CmpID);
+    // Last chunk if it has room, a new one otherwise
+    ArchetypeChunk* GetChunkForAppend();
+    ArchetypeChunk* FindChunk(size_t Row, size_t& LocalRow) const;
+
     int ID;
     ArchSignature Signature;
+    std::pmr::polymorphic_allocator<> Allocator;
     
-    std::unordered_map<EntityID, int> EntityToIndex;
-    std::unordered_map<ComponentID, int> CmpToStoreIndex;
-    
-    VectorStorage<EntityID>* EntityIDStorage;
-    std::vector<IStorage*> CmpStorage;
+    // Indexed by component ID, -1 where the archetype has no such column
+    std::pmr::vector<int> CmpToStoreIndex;
+    // Sorted by component ID, since signatures iterate in ascending order
+    std::pmr::vector<const ComponentInfo*> ColumnInfos;
+    std::pmr::vector<std::pair<ComponentID, EntityID>> Pairs;
+
+    ChunkLayout Layout;
+    size_t RowsPerChunk = SIZE_MAX;
+    // Every chunk but the last one is full
+    std::pmr::vector<ArchetypeChunk*> Chunks;
+    size_t RowCount = 0;
+    bool Idle = false;
+    // Indexed by component ID
+    std::pmr::vector<Edge> Edges;
 };
 
 template <typename T>
-void Archetype::SetValue(const EntityID& ID, const T& Data)
+void Archetype::SetValue(size_t Row, const T& Data, ChangeTick Tick)
 {
     auto CmpType = GetComponent<T>();
-    SetValue(ID, CmpType, &Data);
+    SetValue(Row, CmpType, &Data, Tick);
+}
+
+template <typename Func>
+size_t Archetype::AddEntities(const EntityID* IDs, size_t Count, ChangeTick Tick, const Func& Fill)
+{
+    ECS_TRACE_INSTANT("Add entities", Count);
+    const size_t FirstRow = RowCount;
+    Idle = false;
+    for (size_t Done = 0; Done < Count;)
+    {
+        ArchetypeChunk* Chunk = GetChunkForAppend();
+        const size_t Added = std::min(Count - Done, RowsPerChunk - Chunk->GetCount());
+        Column* EntityColumn = Chunk->GetEntityColumn();
+        EntityColumn->AddBytes(IDs + Done, Added, 0);
+        Chunk->MarkPlaced(Tick);
+        for (size_t i = 0; i < ColumnInfos.size(); i++)
+        {
+            Column* Store = Chunk->GetColumn(i);
+            if (RowsPerChunk == SIZE_MAX)
+            {
+                Store->Reserve(Store->GetSize() + Added);
+            }
+            Fill(*Store, i, Done, Added);
+            Chunk->MarkAdded(i, Tick);
+        }
+        Done += Added;
+        RowCount += Added;
+    }
+    return FirstRow;
+}
+
+template <typename T>
+T* Archetype::GetColumnData(const ArchetypeChunk& Chunk) const
+{
+    const int Index = GetColumnIndex(GetComponent<T>());
+    return Index < 0 ? nullptr : Chunk.GetColumn(Index)->GetData<T>();
+}
+
+template <typename Func>
+void Archetype::ForEachChunk(size_t Begin, size_t End, const Func& Handler) const
+{
+    End = std::min(End, RowCount);
+    while (Begin < End)
+    {
+        size_t LocalBegin;
+        ArchetypeChunk* Chunk = FindChunk(Begin, LocalBegin);
+        const size_t LocalEnd = std::min(Chunk->GetCount(), LocalBegin + (End - Begin));
+        Handler(*Chunk, LocalBegin, LocalEnd);
+        Begin += LocalEnd - LocalBegin;
+    }
 }
 
 template <typename T>
-T* Archetype::GetValue(const EntityID& ID)
+T* Archetype::GetValue(size_t Row)
 {
     auto CmpType = GetComponent<T>();
-    return static_cast<T*>(GetValue(ID, CmpType));
+    return static_cast<T*>(GetValue(Row, CmpType));
 }
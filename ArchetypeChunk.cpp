@@ -0,0 +1,122 @@
+﻿#include "ArchetypeChunk.h"
+
+#include <algorithm>
+
+static constexpr size_t CacheLine = 64;
+
+static size_t AlignUp(size_t Value, size_t Alignment)
+{
+    return (Value + Alignment - 1) / Alignment * Alignment;
+}
+
+ChunkLayout ChunkLayout::Compute(const std::pmr::vector<const ComponentInfo*>& Infos, size_t ChunkBytes)
+{
+    ChunkLayout Layout;
+    size_t RowBytes = ArchetypeChunk::GetEntityIDInfo().Size;
+    for (auto Info : Infos)
+    {
+        RowBytes += Info->Size;
+    }
+
+    // Every column starts on its own cache line, so back off from the ideal row count until the padding fits
+    for (size_t Rows = std::max<size_t>(1, ChunkBytes / RowBytes); ; Rows--)
+    {
+        Layout.Offsets.clear();
+        size_t Offset = 0;
+        auto Place = [&](const ComponentInfo& Info)
+        {
+            Offset = AlignUp(Offset, std::max(Info.Alignment, CacheLine));
+            Layout.Offsets.push_back(Offset);
+            Offset += Column::GetBytes(Info, Rows);
+        };
+        Place(ArchetypeChunk::GetEntityIDInfo());
+        for (auto Info : Infos)
+        {
+            Place(*Info);
+        }
+        // A single row always gets a chunk, even if it is bigger than asked for
+        if (Offset <= ChunkBytes || Rows == 1)
+        {
+            Layout.Capacity = Rows;
+            Layout.BlockBytes = AlignUp(std::max(Offset, ChunkBytes), CacheLine);
+            return Layout;
+        }
+    }
+}
+
+ArchetypeChunk::ArchetypeChunk(const std::pmr::vector<const ComponentInfo*>& Infos, const ChunkLayout& Layout,
+    std::pmr::memory_resource* Resource):
+    Allocator(Resource),
+    Capacity(Layout.Capacity),
+    Columns(Resource),
+    Ticks(Infos.size(), Resource)
+{
+    Columns.reserve(Infos.size());
+    if (Capacity == 0)
+    {
+        EntityIDs = Allocator.new_object<Column>(GetEntityIDInfo(), Resource);
+        for (auto Info : Infos)
+        {
+            Columns.push_back(Allocator.new_object<Column>(*Info, Resource));
+        }
+        return;
+    }
+
+    BlockBytes = Layout.BlockBytes;
+    Block = static_cast<uint8_t*>(Resource->allocate(BlockBytes, CacheLine));
+    EntityIDs = Allocator.new_object<Column>(GetEntityIDInfo(), Block + Layout.Offsets[0], Capacity);
+    for (size_t i = 0; i < Infos.size(); i++)
+    {
+        Columns.push_back(Allocator.new_object<Column>(*Infos[i], Block + Layout.Offsets[i + 1], Capacity));
+    }
+}
+
+ArchetypeChunk::~ArchetypeChunk()
+{
+    Allocator.delete_object(EntityIDs);
+    for (auto Store : Columns)
+    {
+        Allocator.delete_object(Store);
+    }
+    if (Block != nullptr)
+    {
+        Allocator.resource()->deallocate(Block, BlockBytes, CacheLine);
+    }
+}
+
+size_t ArchetypeChunk::ShrinkToFit()
+{
+    if (Block != nullptr)
+    {
+        return 0;
+    }
+    size_t Freed = EntityIDs->ShrinkToFit();
+    for (auto Store : Columns)
+    {
+        Freed += Store->ShrinkToFit();
+    }
+    return Freed;
+}
+
+size_t ArchetypeChunk::GetAllocatedBytes() const
+{
+    size_t Bytes = sizeof(*this) + (Columns.size() + 1) * sizeof(Column) + Columns.capacity() * sizeof(Column*)
+        + Ticks.capacity() * sizeof(ColumnTicks);
+    if (Block != nullptr)
+    {
+        return Bytes + BlockBytes;
+    }
+    Bytes += Column::GetBytes(EntityIDs->GetInfo(), EntityIDs->GetCapacity());
+    for (auto Store : Columns)
+    {
+        Bytes += Column::GetBytes(Store->GetInfo(), Store->GetCapacity());
+    }
+    return Bytes;
+}
+
+const ComponentInfo& ArchetypeChunk::GetEntityIDInfo()
+{
+    // Entity IDs are stored like any other column but are not a registered component
+    static const ComponentInfo Info = MakeComponentInfo<EntityID>();
+    return Info;
+}
@@ -0,0 +1,99 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "Column.h"
+#include "Component.h"
+#include "Types.h"
+
+// Where each column starts inside a chunk block. Shared by every chunk of an archetype
+struct ChunkLayout
+{
+    // Rows that fit in one block, 0 for the unchunked layout where a single chunk grows without bound
+    size_t Capacity = 0;
+    size_t BlockBytes = 0;
+    // Entity IDs first, then the component columns in archetype order
+    std::pmr::vector<size_t> Offsets;
+
+    static ChunkLayout Compute(const std::pmr::vector<const ComponentInfo*>& Infos, size_t ChunkBytes);
+};
+
+// Run of rows of one archetype holding every column for those rows. Chunks with a layout carve all their
+// columns out of one cache line aligned block and never reallocate
+class ArchetypeChunk
+{
+public:
+    // Columns, their buffers and the chunk block all come from Resource
+    ArchetypeChunk(const std::pmr::vector<const ComponentInfo*>& Infos, const ChunkLayout& Layout,
+        std::pmr::memory_resource* Resource);
+    ~ArchetypeChunk();
+    ArchetypeChunk(const ArchetypeChunk& obj) = delete;
+
+    size_t GetCount() const { return EntityIDs->GetSize(); }
+    bool IsFull() const { return Capacity != 0 && GetCount() == Capacity; }
+
+    const EntityID* GetEntityIDs() const { return EntityIDs->GetData<EntityID>(); }
+    Column* GetEntityColumn() const { return EntityIDs; }
+    // Index is the position of the component in the archetype's column list
+    Column* GetColumn(size_t Index) const { return Columns[Index]; }
+    size_t GetColumnCount() const { return Columns.size(); }
+
+    // Trims the columns of an unchunked chunk to its rows, returns the bytes freed. Chunk blocks never change
+    size_t ShrinkToFit();
+    // Everything the chunk holds from its resource
+    size_t GetAllocatedBytes() const;
+
+    // Newest write to any row of a column, and newest row that gained the component. Added rows count as written.
+    // Writes through World::Get may come from several systems at once, so ticks only ever move forward
+    ChangeTick GetChangedTick(size_t Index) const { return Load(Ticks[Index].Changed); }
+    ChangeTick GetAddedTick(size_t Index) const { return Load(Ticks[Index].Added); }
+    void MarkChanged(size_t Index, ChangeTick Tick) { Raise(Ticks[Index].Changed, Tick); }
+    void MarkAdded(size_t Index, ChangeTick Tick)
+    {
+        Raise(Ticks[Index].Added, Tick);
+        Raise(Ticks[Index].Changed, Tick);
+    }
+    // A row moved in from column SourceIndex of Source takes that column's ticks along, so a write or add made
+    // before the move is still seen through this chunk
+    void MarkMoved(size_t Index, const ArchetypeChunk& Source, size_t SourceIndex)
+    {
+        Raise(Ticks[Index].Changed, Source.GetChangedTick(SourceIndex));
+        Raise(Ticks[Index].Added, Source.GetAddedTick(SourceIndex));
+    }
+    // Newest row appended by an entity entering the archetype
+    ChangeTick GetPlacedTick() const { return Load(PlacedTick); }
+    void MarkPlaced(ChangeTick Tick) { Raise(PlacedTick, Tick); }
+
+    static const ComponentInfo& GetEntityIDInfo();
+
+private:
+    struct ColumnTicks
+    {
+        ChangeTick Changed = 0;
+        ChangeTick Added = 0;
+    };
+
+    static ChangeTick Load(const ChangeTick& Stamp)
+    {
+        return std::atomic_ref<ChangeTick>(const_cast<ChangeTick&>(Stamp)).load(std::memory_order_relaxed);
+    }
+    static void Raise(ChangeTick& Stamp, ChangeTick Tick)
+    {
+        std::atomic_ref<ChangeTick> Ref(Stamp);
+        ChangeTick Current = Ref.load(std::memory_order_relaxed);
+        while (Current < Tick && !Ref.compare_exchange_weak(Current, Tick, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    std::pmr::polymorphic_allocator<> Allocator;
+    uint8_t* Block = nullptr;
+    size_t BlockBytes = 0;
+    size_t Capacity = 0;
+    Column* EntityIDs;
+    std::pmr::vector<Column*> Columns;
+    std::pmr::vector<ColumnTicks> Ticks;
+    ChangeTick PlacedTick = 0;
+};
@@ -0,0 +1,204 @@
+﻿#include "BenchHarness.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <regex>
+#include <thread>
+
+struct RegisteredBenchmark
+{
+    std::string Name;
+    BenchFunction Func;
+    size_t Arg;
+};
+
+struct BenchResult
+{
+    std::string Name;
+    size_t Iterations;
+    double RealNs;
+    double CPUNs;
+    double ItemsPerSecond;
+};
+
+static std::vector<RegisteredBenchmark>& GetBenchmarks()
+{
+    static std::vector<RegisteredBenchmark> Benchmarks;
+    return Benchmarks;
+}
+
+static double CPUSeconds()
+{
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+BenchState::BenchState(size_t Arg, size_t Iterations): Arg(Arg), Iterations(Iterations)
+{
+}
+
+void BenchState::PauseTiming()
+{
+    if (!Running)
+    {
+        return;
+    }
+    Elapsed += std::chrono::steady_clock::now() - Start;
+    CPUElapsed += CPUSeconds() - CPUStart;
+    Running = false;
+}
+
+void BenchState::ResumeTiming()
+{
+    if (Running)
+    {
+        return;
+    }
+    Running = true;
+    CPUStart = CPUSeconds();
+    Start = std::chrono::steady_clock::now();
+}
+
+BenchState::Iterator BenchState::begin()
+{
+    ResumeTiming();
+    return Iterator(this, Iterations);
+}
+
+void RegisterBenchmark(const std::string& Name, BenchFunction Func, const std::vector<size_t>& Args)
+{
+    for (size_t Arg : Args)
+    {
+        GetBenchmarks().push_back({Name + "/" + std::to_string(Arg), Func, Arg});
+    }
+}
+
+// Grows the iteration count until one run lasts MinTime, the way Google Benchmark does
+static BenchResult Measure(const RegisteredBenchmark& Bench, double MinTime)
+{
+    size_t Iterations = 1;
+    while (true)
+    {
+        BenchState State(Bench.Arg, Iterations);
+        Bench.Func(State);
+        const double Seconds = State.GetElapsedSeconds();
+        if (Seconds >= MinTime || Iterations >= 1000000000)
+        {
+            BenchResult Result;
+            Result.Name = Bench.Name;
+            Result.Iterations = Iterations;
+            Result.RealNs = Seconds * 1e9 / Iterations;
+            Result.CPUNs = State.GetCPUSeconds() * 1e9 / Iterations;
+            Result.ItemsPerSecond = Seconds > 0 ? State.GetItemsProcessed() * Iterations / Seconds : 0;
+            return Result;
+        }
+        const double Multiplier = Seconds <= 0 ? 10.0 : std::min(10.0, std::max(1.4 * MinTime / Seconds, 2.0));
+        Iterations = static_cast<size_t>(Iterations * Multiplier);
+    }
+}
+
+static void WriteJSON(FILE* Out, const std::vector<BenchResult>& Results)
+{
+    char Date[64];
+    const time_t Now = time(nullptr);
+    strftime(Date, sizeof(Date), "%Y-%m-%dT%H:%M:%S", localtime(&Now));
+#ifdef NDEBUG
+    const char* BuildType = "release";
+#else
+    const char* BuildType = "debug";
+#endif
+    fprintf(Out, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"num_cpus\": %u,\n"
+        "    \"library_build_type\": \"%s\"\n  },\n  \"benchmarks\": [\n",
+        Date, std::thread::hardware_concurrency(), BuildType);
+    for (size_t i = 0; i < Results.size(); i++)
+    {
+        const BenchResult& Result = Results[i];
+        fprintf(Out, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n"
+            "      \"iterations\": %zu,\n      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n"
+            "      \"time_unit\": \"ns\",\n      \"items_per_second\": %.3f\n    }%s\n",
+            Result.Name.c_str(), Result.Name.c_str(), Result.Iterations, Result.RealNs, Result.CPUNs,
+            Result.ItemsPerSecond, i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(Out, "  ]\n}\n");
+}
+
+static const char* GetFlag(const char* Arg, const char* Name)
+{
+    const size_t Length = strlen(Name);
+    if (strncmp(Arg, Name, Length) == 0 && Arg[Length] == '=')
+    {
+        return Arg + Length + 1;
+    }
+    return nullptr;
+}
+
+int RunBenchmarks(int argc, char** argv)
+{
+    std::regex Filter(".*");
+    std::string OutPath;
+    bool ConsoleJSON = false;
+    double MinTime = 0.5;
+    for (int i = 1; i < argc; i++)
+    {
+        if (const char* Value = GetFlag(argv[i], "--benchmark_filter"))
+        {
+            Filter = std::regex(Value);
+        }
+        else if (const char* Value = GetFlag(argv[i], "--benchmark_out"))
+        {
+            OutPath = Value;
+        }
+        else if (const char* Value = GetFlag(argv[i], "--benchmark_format"))
+        {
+            ConsoleJSON = strcmp(Value, "json") == 0;
+        }
+        else if (const char* Value = GetFlag(argv[i], "--benchmark_min_time"))
+        {
+            MinTime = atof(Value);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> Results;
+    if (!ConsoleJSON)
+    {
+        printf("%-40s %15s %15s %12s %15s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Items/s");
+    }
+    for (const auto& Bench : GetBenchmarks())
+    {
+        if (!std::regex_search(Bench.Name, Filter))
+        {
+            continue;
+        }
+        Results.push_back(Measure(Bench, MinTime));
+        const BenchResult& Result = Results.back();
+        if (!ConsoleJSON)
+        {
+            printf("%-40s %15.0f %15.0f %12zu %15.0f\n", Result.Name.c_str(), Result.RealNs, Result.CPUNs,
+                Result.Iterations, Result.ItemsPerSecond);
+            fflush(stdout);
+        }
+    }
+    if (ConsoleJSON)
+    {
+        WriteJSON(stdout, Results);
+    }
+    if (!OutPath.empty())
+    {
+        FILE* Out = fopen(OutPath.c_str(), "w");
+        if (Out == nullptr)
+        {
+            fprintf(stderr, "Could not open %s\n", OutPath.c_str());
+            return 1;
+        }
+        WriteJSON(Out, Results);
+        fclose(Out);
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+﻿#pragma once
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal stand in for Google Benchmark so the suite builds without dependencies. Benchmarks loop with
+//   for (auto _ : State) { ... }
+// and report in the same console and JSON formats, so the usual comparison tools work on the output
+class BenchState
+{
+public:
+    BenchState(size_t Arg, size_t Iterations);
+
+    // Size the benchmark was registered with, usually the entity count
+    size_t GetArg() const { return Arg; }
+    size_t GetIterations() const { return Iterations; }
+
+    // Excludes per iteration setup and teardown from the measurement
+    void PauseTiming();
+    void ResumeTiming();
+
+    // Items handled per iteration, reported as items_per_second
+    void SetItemsProcessed(size_t Items) { ItemsProcessed = Items; }
+    size_t GetItemsProcessed() const { return ItemsProcessed; }
+
+    double GetElapsedSeconds() const { return Elapsed.count(); }
+    double GetCPUSeconds() const { return CPUElapsed; }
+
+    // Not trivially destructible so the unused loop variable draws no warning
+    struct Value
+    {
+        ~Value() {}
+    };
+
+    class Iterator
+    {
+    public:
+        Iterator(BenchState* State, size_t Remaining): State(State), Remaining(Remaining) {}
+        Value operator*() const { return Value(); }
+        Iterator& operator++()
+        {
+            Remaining--;
+            return *this;
+        }
+        bool operator!=(const Iterator&)
+        {
+            if (Remaining > 0)
+            {
+                return true;
+            }
+            State->PauseTiming();
+            return false;
+        }
+
+    private:
+        BenchState* State;
+        size_t Remaining;
+    };
+
+    Iterator begin();
+    Iterator end() { return Iterator(this, 0); }
+
+private:
+    size_t Arg;
+    size_t Iterations;
+    size_t ItemsProcessed = 0;
+    bool Running = false;
+    std::chrono::steady_clock::time_point Start;
+    std::chrono::duration<double> Elapsed{0};
+    double CPUStart = 0;
+    double CPUElapsed = 0;
+};
+
+typedef std::function<void(BenchState&)> BenchFunction;
+
+// Registers Func once per argument, named Name/Arg
+void RegisterBenchmark(const std::string& Name, BenchFunction Func, const std::vector<size_t>& Args);
+
+// Runs every registered benchmark matching the --benchmark_filter regex. Understands --benchmark_min_time=<seconds>,
+// --benchmark_format=console|json and --benchmark_out=<file>, which always receives JSON
+int RunBenchmarks(int argc, char** argv);
+
+// Keeps the optimizer from dropping a computed value
+template<typename T>
+inline void DoNotOptimize(const T& Value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(Value) : "memory");
+#else
+    static volatile const void* Sink;
+    Sink = &Value;
+#endif
+}
@@ -0,0 +1,420 @@
+﻿#include <algorithm>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "BenchHarness.h"
+#include "Entity.h"
+#include "ErrorHandling.h"
+#include "World.h"
+
+struct Position
+{
+    float X;
+    float Y;
+};
+
+struct Velocity
+{
+    float X;
+    float Y;
+};
+
+struct Health
+{
+    int Value;
+};
+
+// Status toggled on and off, once kept in the archetype and once in a sparse set
+struct Stunned
+{
+    int Turns;
+};
+
+struct SparseStunned
+{
+    int Turns;
+};
+
+template<>
+struct ComponentStorage<SparseStunned>
+{
+    static constexpr bool Sparse = true;
+};
+
+// Tags used to scatter entities over many archetypes
+template<int I>
+struct Tag
+{
+    int Value;
+};
+
+static const std::vector<size_t> Sizes = {1000, 100000, 1000000};
+static constexpr int FragmentBits = 8;
+
+// Fixed seed so every run shuffles the same way
+static std::vector<EntityID> Shuffled(std::vector<EntityID> IDs)
+{
+    std::mt19937 Rng(1234);
+    std::shuffle(IDs.begin(), IDs.end(), Rng);
+    return IDs;
+}
+
+static std::vector<EntityID> Populate(World& Wld, size_t Count)
+{
+    std::vector<EntityID> IDs;
+    IDs.reserve(Count);
+    for (size_t i = 0; i < Count; i++)
+    {
+        auto E = Wld.NewEntity();
+        E.Set<Position>({static_cast<float>(i), 0}).Set<Velocity>({1, 0.5f});
+        IDs.push_back(E.GetID());
+    }
+    return IDs;
+}
+
+template<int... Is>
+static void SetTags(World& Wld, EntityID Entity, size_t Mask, std::integer_sequence<int, Is...>)
+{
+    ((Mask & (size_t(1) << Is) ? Wld.Set<Tag<Is>>(Entity, {Is}) : void()), ...);
+}
+
+// Spreads entities over 2^FragmentBits archetypes that all share Position and Velocity
+static std::vector<EntityID> PopulateFragmented(World& Wld, size_t Count)
+{
+    std::vector<EntityID> IDs = Populate(Wld, Count);
+    for (size_t i = 0; i < Count; i++)
+    {
+        SetTags(Wld, IDs[i], i % (1 << FragmentBits), std::make_integer_sequence<int, FragmentBits>());
+    }
+    return IDs;
+}
+
+static void AddMovement(World& Wld)
+{
+    Wld.AddSystem<Position, const Velocity>([](Position& Pos, const Velocity& Vel)
+    {
+        Pos.X += Vel.X;
+        Pos.Y += Vel.Y;
+    });
+}
+
+// NewEntity followed by Set, migrating through every intermediate archetype
+static void BenchNewEntity(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        State.ResumeTiming();
+        DoNotOptimize(Populate(*Wld, State.GetArg()));
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchSpawn(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        State.ResumeTiming();
+        Wld->Spawn<Position, Velocity>(State.GetArg(), [](Position&, Velocity& Vel)
+        {
+            Vel = {1, 0.5f};
+        });
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+// Set of a new component, moving every entity to the next archetype
+static void BenchSetMigration(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        const std::vector<EntityID> IDs = Populate(*Wld, State.GetArg());
+        State.ResumeTiming();
+        for (EntityID ID : IDs)
+        {
+            Wld->Set<Health>(ID, {100});
+        }
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchRemove(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        const std::vector<EntityID> IDs = Populate(*Wld, State.GetArg());
+        State.ResumeTiming();
+        for (EntityID ID : IDs)
+        {
+            Wld->Remove<Velocity>(ID);
+        }
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchGetRandom(BenchState& State)
+{
+    World Wld;
+    const std::vector<EntityID> IDs = Shuffled(Populate(Wld, State.GetArg()));
+    for (auto _ : State)
+    {
+        float Sum = 0;
+        for (EntityID ID : IDs)
+        {
+            Sum += Wld.Get<Position>(ID)->X;
+        }
+        DoNotOptimize(Sum);
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchDelete(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        const std::vector<EntityID> IDs = Shuffled(Populate(*Wld, State.GetArg()));
+        State.ResumeTiming();
+        for (EntityID ID : IDs)
+        {
+            Wld->Delete(ID);
+        }
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchTick(BenchState& State)
+{
+    World Wld;
+    Populate(Wld, State.GetArg());
+    AddMovement(Wld);
+    for (auto _ : State)
+    {
+        Wld.Tick();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+static void BenchTickFragmented(BenchState& State)
+{
+    World Wld;
+    PopulateFragmented(Wld, State.GetArg());
+    AddMovement(Wld);
+    for (auto _ : State)
+    {
+        Wld.Tick();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+// Replication style pass that only wants the rows written since its last run, with 2% of entities moving each
+// tick. Filters work per storage chunk, so the movers are neighbours here; scattered movers dirty every chunk
+static void BenchTickChanged(BenchState& State)
+{
+    WorldConfig Config;
+    Config.ChunkBytes = 16 * 1024;
+    World Wld(Config);
+    const std::vector<EntityID> IDs = Populate(Wld, State.GetArg());
+    float Sum = 0;
+    Wld.AddSystem<Changed<const Position>>([&Sum](std::span<const Position> Positions)
+    {
+        for (const Position& P : Positions)
+        {
+            Sum += P.X;
+        }
+    });
+    const size_t Moving = std::max<size_t>(1, IDs.size() / 50);
+    size_t Next = 0;
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        for (size_t i = 0; i < Moving; i++, Next = (Next + 1) % IDs.size())
+        {
+            Wld.Set<Position>(IDs[Next], {1, 1});
+        }
+        State.ResumeTiming();
+        Wld.Tick();
+    }
+    DoNotOptimize(Sum);
+    State.SetItemsProcessed(State.GetArg());
+}
+
+// Migration when every entity takes a different edge out of one of many archetypes
+static void BenchSetFragmented(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        const std::vector<EntityID> IDs = PopulateFragmented(*Wld, State.GetArg());
+        State.ResumeTiming();
+        for (EntityID ID : IDs)
+        {
+            Wld->Set<Health>(ID, {100});
+        }
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+template<int... Is>
+static void AddTagQueries(World& Wld, size_t Count, std::integer_sequence<int, Is...>)
+{
+    const ComponentID Tags[] = {GetComponent<Tag<Is>>()...};
+    for (size_t i = 0; i < Count; i++)
+    {
+        Wld.AddQuery(ArchSignature{Tags[i % FragmentBits], GetComponent<Health>()});
+    }
+}
+
+// Archetype creation with many live queries, each new archetype is only offered to queries on its components
+static void BenchFragmentQueries(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        AddTagQueries(*Wld, 1000, std::make_integer_sequence<int, FragmentBits>());
+        State.ResumeTiming();
+        DoNotOptimize(PopulateFragmented(*Wld, State.GetArg()));
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+// Adds then removes a status on every entity, which migrates rows twice unless the status is sparse
+template<typename T>
+static void BenchToggle(BenchState& State)
+{
+    for (auto _ : State)
+    {
+        State.PauseTiming();
+        auto Wld = std::make_unique<World>();
+        const std::vector<EntityID> IDs = Populate(*Wld, State.GetArg());
+        State.ResumeTiming();
+        for (EntityID ID : IDs)
+        {
+            Wld->Set<T>(ID, {3});
+        }
+        for (EntityID ID : IDs)
+        {
+            Wld->Remove<T>(ID);
+        }
+        State.PauseTiming();
+        Wld.reset();
+        State.ResumeTiming();
+    }
+    State.SetItemsProcessed(State.GetArg() * 2);
+}
+
+// Transform propagation over trees where every node has 8 children, parents always visited before children.
+// Every parent gets archetypes of its own, so sizes stay smaller than elsewhere
+static void BenchHierarchy(BenchState& State)
+{
+    World Wld;
+    std::vector<EntityID> IDs = Populate(Wld, State.GetArg());
+    for (size_t i = 1; i < IDs.size(); i++)
+    {
+        Wld.AddPair<ChildOf>(IDs[i], IDs[(i - 1) / 8]);
+    }
+    for (auto _ : State)
+    {
+        Wld.ForEachInHierarchy<ChildOf, const Velocity, Position>(
+            [](World* Wrld, EntityID Entity, const Velocity& Local, Position& Global)
+            {
+                const EntityID Parent = Wrld->GetTarget<ChildOf>(Entity);
+                const Position Base = Parent != 0 ? *Wrld->Get<Position>(Parent) : Position{0, 0};
+                Global = {Base.X + Local.X, Base.Y + Local.Y};
+            });
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+// Parents come and go with their children, as in a scene loading and unloading. Pair IDs of deleted parents are
+// recycled, so the component registry must stay the size the first round left it at
+static void BenchHierarchyChurn(BenchState& State)
+{
+    World Wld;
+    std::vector<EntityID> Parents;
+    size_t Registered = 0;
+    for (auto _ : State)
+    {
+        Parents.clear();
+        for (size_t i = 0; i < State.GetArg(); i += 8)
+        {
+            Entity Parent = Wld.NewEntity();
+            Parent.Set<Position>({0, 0});
+            Parents.push_back(Parent.GetID());
+            for (size_t Child = 1; Child < 8; Child++)
+            {
+                Entity Node = Wld.NewEntity();
+                Node.Set<Position>({0, 0});
+                Wld.AddPair<ChildOf>(Node.GetID(), Parent.GetID());
+            }
+        }
+        for (EntityID Parent : Parents)
+        {
+            Wld.Delete(Parent);
+        }
+        Wld.Tick();
+        if (Registered == 0)
+        {
+            Registered = GetComponentCount();
+        }
+        else if (GetComponentCount() > Registered)
+        {
+            Error("Pair components leak, %zu registered after the first round and %zu now\n", Registered,
+                GetComponentCount());
+        }
+    }
+    State.SetItemsProcessed(State.GetArg());
+}
+
+int main(int argc, char** argv)
+{
+    RegisterBenchmark("NewEntity", BenchNewEntity, Sizes);
+    RegisterBenchmark("Spawn", BenchSpawn, Sizes);
+    RegisterBenchmark("SetMigration", BenchSetMigration, Sizes);
+    RegisterBenchmark("Remove", BenchRemove, Sizes);
+    RegisterBenchmark("GetRandom", BenchGetRandom, Sizes);
+    RegisterBenchmark("Delete", BenchDelete, Sizes);
+    RegisterBenchmark("Tick", BenchTick, Sizes);
+    RegisterBenchmark("TickFragmented", BenchTickFragmented, Sizes);
+    RegisterBenchmark("SetFragmented", BenchSetFragmented, Sizes);
+    RegisterBenchmark("TickChanged", BenchTickChanged, Sizes);
+    RegisterBenchmark("FragmentQueries", BenchFragmentQueries, Sizes);
+    RegisterBenchmark("ToggleTable", BenchToggle<Stunned>, Sizes);
+    RegisterBenchmark("ToggleSparse", BenchToggle<SparseStunned>, Sizes);
+    RegisterBenchmark("Hierarchy", BenchHierarchy, {1000, 10000, 100000});
+    RegisterBenchmark("HierarchyChurn", BenchHierarchyChurn, {1000, 10000});
+    return RunBenchmarks(argc, argv);
+}
@@ -0,0 +1,73 @@
+﻿#include "BumpArena.h"
+
+#include <algorithm>
+
+static constexpr size_t BlockAlignment = alignof(std::max_align_t);
+
+BumpArena::BumpArena(std::pmr::memory_resource* Upstream, size_t FirstBlockSize):
+    Upstream(Upstream),
+    FirstBlockSize(FirstBlockSize),
+    NextBlockSize(FirstBlockSize)
+{
+}
+
+BumpArena::~BumpArena()
+{
+    for (const Block& Blk : Blocks)
+    {
+        Upstream->deallocate(Blk.Data, Blk.Size, BlockAlignment);
+    }
+}
+
+void BumpArena::Reset()
+{
+    Current = 0;
+    Offset = 0;
+}
+
+size_t BumpArena::Release()
+{
+    size_t Freed = 0;
+    for (const Block& Blk : Blocks)
+    {
+        Upstream->deallocate(Blk.Data, Blk.Size, BlockAlignment);
+        Freed += Blk.Size;
+    }
+    Blocks.clear();
+    NextBlockSize = FirstBlockSize;
+    Reset();
+    return Freed;
+}
+
+void* BumpArena::do_allocate(size_t Bytes, size_t Alignment)
+{
+    while (Current < Blocks.size())
+    {
+        const Block& Blk = Blocks[Current];
+        const size_t Start = (Offset + Alignment - 1) / Alignment * Alignment;
+        if (Start + Bytes <= Blk.Size)
+        {
+            Offset = Start + Bytes;
+            return Blk.Data + Start;
+        }
+        Current++;
+        Offset = 0;
+    }
+
+    // Out of retained blocks, grow geometrically so a steady state needs only a few of them
+    const size_t Size = std::max(NextBlockSize, Bytes + Alignment);
+    NextBlockSize = Size * 2;
+    Blocks.push_back({static_cast<std::byte*>(Upstream->allocate(Size, BlockAlignment)), Size});
+    Current = Blocks.size() - 1;
+    Offset = 0;
+    return do_allocate(Bytes, Alignment);
+}
+
+void BumpArena::do_deallocate(void*, size_t, size_t)
+{
+}
+
+bool BumpArena::do_is_equal(const std::pmr::memory_resource& Other) const noexcept
+{
+    return this == &Other;
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for memory that all dies at once. Deallocation does nothing and Reset rewinds to the first
+// block while keeping every block, so once it has grown to the size a tick needs it stops touching Upstream.
+// Not thread safe, use one per thread
+class BumpArena : public std::pmr::memory_resource
+{
+public:
+    explicit BumpArena(std::pmr::memory_resource* Upstream, size_t FirstBlockSize = 4096);
+    ~BumpArena() override;
+    BumpArena(const BumpArena& obj) = delete;
+
+    // Every allocation made so far becomes invalid
+    void Reset();
+    // Same as Reset but hands every block back to Upstream, for when a spike left more than a tick needs.
+    // Returns the bytes freed
+    size_t Release();
+
+protected:
+    void* do_allocate(size_t Bytes, size_t Alignment) override;
+    void do_deallocate(void* Ptr, size_t Bytes, size_t Alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& Other) const noexcept override;
+
+private:
+    struct Block
+    {
+        std::byte* Data;
+        size_t Size;
+    };
+
+    std::pmr::memory_resource* Upstream;
+    std::vector<Block> Blocks;
+    size_t FirstBlockSize;
+    size_t NextBlockSize;
+    // Block being bumped and the offset of its first free byte
+    size_t Current = 0;
+    size_t Offset = 0;
+};
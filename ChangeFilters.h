@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <type_traits>
+
+// Filter terms for typed systems. Listing Changed<T> in place of T only visits storage chunks where T was written
+// since the system last ran, Added<T> only those where some entity gained T. Every row of a passing chunk is
+// visited and the handler takes T exactly as it would without the filter
+template<typename T>
+struct Changed
+{
+};
+
+template<typename T>
+struct Added
+{
+};
+
+template<typename T>
+struct FilterTerm
+{
+    using Type = T;
+    static constexpr bool IsChanged = false;
+    static constexpr bool IsAdded = false;
+};
+
+template<typename T>
+struct FilterTerm<Changed<T>>
+{
+    using Type = T;
+    static constexpr bool IsChanged = true;
+    static constexpr bool IsAdded = false;
+};
+
+template<typename T>
+struct FilterTerm<Added<T>>
+{
+    using Type = T;
+    static constexpr bool IsChanged = false;
+    static constexpr bool IsAdded = true;
+};
+
+// Component a system term refers to, filter stripped and constness kept
+template<typename T>
+using Unfiltered = typename FilterTerm<T>::Type;
+
+template<typename T>
+constexpr bool IsChangeFilter = FilterTerm<T>::IsChanged || FilterTerm<T>::IsAdded;
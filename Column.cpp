@@ -0,0 +1,300 @@
+﻿#include "Column.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "ErrorHandling.h"
+
+static constexpr size_t MinColumnAlignment = 64;
+
+static size_t ColumnAlignment(const ComponentInfo& Info)
+{
+    return std::max(Info.Alignment, MinColumnAlignment);
+}
+
+// Field arrays are padded so each one starts on a cache line
+static size_t FieldStrideFor(const ComponentInfo& Info, size_t Capacity)
+{
+    if (Info.FieldCount == 0)
+    {
+        return 0;
+    }
+    const size_t Step = MinColumnAlignment / std::gcd(MinColumnAlignment, Info.FieldSize);
+    return (Capacity + Step - 1) / Step * Step;
+}
+
+Column::Column(const ComponentInfo& Info, std::pmr::memory_resource* Resource): Info(&Info), Resource(Resource)
+{
+}
+
+Column::Column(const ComponentInfo& Info, void* Buffer, size_t Capacity):
+    Info(&Info),
+    Data(static_cast<uint8_t*>(Buffer)),
+    Capacity(Capacity),
+    FieldStride(FieldStrideFor(Info, Capacity)),
+    OwnsData(false)
+{
+}
+
+size_t Column::GetBytes(const ComponentInfo& Info, size_t Capacity)
+{
+    if (Info.FieldCount > 0)
+    {
+        return Info.FieldCount * FieldStrideFor(Info, Capacity) * Info.FieldSize;
+    }
+    return Capacity * Info.Size;
+}
+
+void* Column::Get(size_t Row)
+{
+    if (IsSplit())
+    {
+        Error("Component %d is split into fields and has no row address\n", GetTypeID());
+    }
+    return Data + Row * Info->Size;
+}
+
+const void* Column::Get(size_t Row) const
+{
+    return const_cast<Column*>(this)->Get(Row);
+}
+
+Column::~Column()
+{
+    Clear();
+    if (Data != nullptr && OwnsData)
+    {
+        Resource->deallocate(Data, GetBytes(*Info, Capacity), ColumnAlignment(*Info));
+    }
+}
+
+void Column::Reserve(size_t NewCapacity)
+{
+    if (NewCapacity <= Capacity)
+    {
+        return;
+    }
+    if (!OwnsData)
+    {
+        Error("Column of type %d cannot grow past its fixed capacity %zu\n", GetTypeID(), Capacity);
+    }
+    Reallocate(NewCapacity);
+}
+
+size_t Column::ShrinkToFit()
+{
+    const size_t Before = GetBytes(*Info, Capacity);
+    if (!OwnsData || GetBytes(*Info, Size) == Before)
+    {
+        return 0;
+    }
+    Reallocate(Size);
+    return Before - GetBytes(*Info, Capacity);
+}
+
+void Column::Reallocate(size_t NewCapacity)
+{
+    uint8_t* NewData = NewCapacity == 0 ? nullptr : static_cast<uint8_t*>(
+        Resource->allocate(GetBytes(*Info, NewCapacity), ColumnAlignment(*Info)));
+    const size_t NewStride = FieldStrideFor(*Info, NewCapacity);
+    if (Data != nullptr && Size > 0)
+    {
+        if (IsSplit())
+        {
+            for (size_t Field = 0; Field < Info->FieldCount; Field++)
+            {
+                memcpy(NewData + Field * NewStride * Info->FieldSize, GetField(Field), Size * Info->FieldSize);
+            }
+        }
+        else if (Info->TriviallyCopyable)
+        {
+            memcpy(NewData, Data, Size * Info->Size);
+        }
+        else
+        {
+            for (size_t i = 0; i < Size; i++)
+            {
+                Info->MoveConstruct(NewData + i * Info->Size, Data + i * Info->Size);
+            }
+            Info->Destroy(Data, Size);
+        }
+    }
+    if (Data != nullptr)
+    {
+        Resource->deallocate(Data, GetBytes(*Info, Capacity), ColumnAlignment(*Info));
+    }
+    Data = NewData;
+    Capacity = NewCapacity;
+    FieldStride = NewStride;
+}
+
+void Column::Grow(size_t MinCapacity)
+{
+    if (MinCapacity > Capacity)
+    {
+        Reserve(std::max(MinCapacity, Capacity * 2));
+    }
+}
+
+void Column::AddDefault(size_t Count)
+{
+    Grow(Size + Count);
+    if (IsSplit())
+    {
+        for (size_t Field = 0; Field < Info->FieldCount; Field++)
+        {
+            memset(static_cast<uint8_t*>(GetField(Field)) + Size * Info->FieldSize, 0, Count * Info->FieldSize);
+        }
+    }
+    else if (Info->TriviallyCopyable)
+    {
+        memset(Get(Size), 0, Count * Info->Size);
+    }
+    else
+    {
+        Info->DefaultConstruct(Get(Size), Count);
+    }
+    Size += Count;
+}
+
+void Column::AddCopy(const void* Value)
+{
+    Grow(Size + 1);
+    if (IsSplit())
+    {
+        WriteRow(Size, Value);
+    }
+    else if (Info->TriviallyCopyable)
+    {
+        memcpy(Get(Size), Value, Info->Size);
+    }
+    else
+    {
+        Info->CopyConstruct(Get(Size), Value);
+    }
+    Size++;
+}
+
+void Column::AddBytes(const void* Source, size_t Count, size_t SourceFieldStride)
+{
+    if (!Info->TriviallyCopyable)
+    {
+        Error("Raw bytes added to column of component %d which is not trivially copyable\n", Info->ID);
+    }
+    Grow(Size + Count);
+    const uint8_t* Bytes = static_cast<const uint8_t*>(Source);
+    if (IsSplit())
+    {
+        for (size_t Field = 0; Field < Info->FieldCount; Field++)
+        {
+            memcpy(static_cast<uint8_t*>(GetField(Field)) + Size * Info->FieldSize,
+                Bytes + Field * SourceFieldStride * Info->FieldSize, Count * Info->FieldSize);
+        }
+    }
+    else
+    {
+        memcpy(Get(Size), Bytes, Count * Info->Size);
+    }
+    Size += Count;
+}
+
+void Column::Set(size_t Row, const void* Value)
+{
+    if (IsSplit())
+    {
+        WriteRow(Row, Value);
+    }
+    else if (Info->TriviallyCopyable)
+    {
+        memmove(Get(Row), Value, Info->Size);
+    }
+    else
+    {
+        Info->CopyAssign(Get(Row), Value);
+    }
+}
+
+void Column::AddMoved(Column& Source, size_t SourceRow, size_t Count)
+{
+    if (Source.Info != Info)
+    {
+        Error("Moving rows between columns of different types %d and %d\n", Source.GetTypeID(), GetTypeID());
+    }
+    Grow(Size + Count);
+    if (IsSplit())
+    {
+        for (size_t Field = 0; Field < Info->FieldCount; Field++)
+        {
+            memcpy(static_cast<uint8_t*>(GetField(Field)) + Size * Info->FieldSize,
+                static_cast<uint8_t*>(Source.GetField(Field)) + SourceRow * Info->FieldSize,
+                Count * Info->FieldSize);
+        }
+    }
+    else if (Info->TriviallyCopyable)
+    {
+        memcpy(Get(Size), Source.Get(SourceRow), Count * Info->Size);
+    }
+    else
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            Info->MoveConstruct(Get(Size + i), Source.Get(SourceRow + i));
+        }
+    }
+    Size += Count;
+}
+
+void Column::ReplaceWithMoved(size_t Row, Column& Source, size_t SourceRow)
+{
+    if (&Source == this && Row == SourceRow)
+    {
+        return;
+    }
+    if (IsSplit())
+    {
+        for (size_t Field = 0; Field < Info->FieldCount; Field++)
+        {
+            memcpy(static_cast<uint8_t*>(GetField(Field)) + Row * Info->FieldSize,
+                static_cast<uint8_t*>(Source.GetField(Field)) + SourceRow * Info->FieldSize,
+                Info->FieldSize);
+        }
+    }
+    else if (Info->TriviallyCopyable)
+    {
+        memcpy(Get(Row), Source.Get(SourceRow), Info->Size);
+    }
+    else
+    {
+        Info->Destroy(Get(Row), 1);
+        Info->MoveConstruct(Get(Row), Source.Get(SourceRow));
+    }
+}
+
+void Column::PopBack()
+{
+    Size--;
+    if (!Info->TriviallyCopyable)
+    {
+        Info->Destroy(Get(Size), 1);
+    }
+}
+
+void Column::Clear()
+{
+    if (!Info->TriviallyCopyable && Size > 0)
+    {
+        Info->Destroy(Data, Size);
+    }
+    Size = 0;
+}
+
+void Column::WriteRow(size_t Row, const void* Value)
+{
+    uint8_t* Fields = Data + Row * Info->FieldSize;
+    for (size_t Field = 0; Field < Info->FieldCount; Field++)
+    {
+        memcpy(Fields + Field * FieldStride * Info->FieldSize,
+            static_cast<const uint8_t*>(Value) + Field * Info->FieldSize, Info->FieldSize);
+    }
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "Component.h"
+
+// Type erased array of one component. Rows live in a raw buffer aligned to at least a cache line and are
+// moved with memcpy for trivially copyable types, falling back on the ComponentInfo functions otherwise.
+// Split components keep one cache line aligned array per field instead, rows are gathered and scattered
+class Column
+{
+public:
+    explicit Column(const ComponentInfo& Info, std::pmr::memory_resource* Resource = std::pmr::get_default_resource());
+    // Column living in memory owned by someone else, it can never hold more than Capacity rows
+    Column(const ComponentInfo& Info, void* Buffer, size_t Capacity);
+    ~Column();
+    Column(const Column& obj) = delete;
+
+    ComponentID GetTypeID() const { return Info->ID; }
+    const ComponentInfo& GetInfo() const { return *Info; }
+
+    size_t GetSize() const { return Size; }
+    size_t GetCapacity() const { return Capacity; }
+    // Bytes needed to hold Capacity rows of the component
+    static size_t GetBytes(const ComponentInfo& Info, size_t Capacity);
+
+    // Row addresses only exist for components that are not split
+    void* Get(size_t Row);
+    const void* Get(size_t Row) const;
+    void* GetData() { return Data; }
+
+    template<typename T>
+    T* GetData() { return reinterpret_cast<T*>(Data); }
+
+    bool IsSplit() const { return Info->FieldCount > 0; }
+    void* GetField(size_t Field) { return Data + Field * FieldStride * Info->FieldSize; }
+    // Rows between the starts of two field arrays
+    size_t GetFieldStride() const { return FieldStride; }
+
+    void Reserve(size_t NewCapacity);
+    // Gives back the capacity past the last row, returns the bytes freed. Columns in a chunk block keep theirs
+    size_t ShrinkToFit();
+    // Appends Count value initialized rows
+    void AddDefault(size_t Count);
+    void AddCopy(const void* Value);
+    // Appends Count rows copied bit for bit from Source, which holds whole rows or, for split columns, one array
+    // per field SourceFieldStride rows apart. Only for trivially copyable components
+    void AddBytes(const void* Source, size_t Count, size_t SourceFieldStride);
+    void Set(size_t Row, const void* Value);
+    // Appends rows moved out of Source. The source rows stay constructed and are destroyed by their owner
+    void AddMoved(Column& Source, size_t SourceRow, size_t Count = 1);
+    // Overwrites Row with a row moved out of Source, which may be this column
+    void ReplaceWithMoved(size_t Row, Column& Source, size_t SourceRow);
+    void PopBack();
+    void Clear();
+
+private:
+    void Grow(size_t MinCapacity);
+    void Reallocate(size_t NewCapacity);
+    void WriteRow(size_t Row, const void* Value);
+
+    const ComponentInfo* Info;
+    std::pmr::memory_resource* Resource = nullptr;
+    uint8_t* Data = nullptr;
+    size_t Size = 0;
+    size_t Capacity = 0;
+    size_t FieldStride = 0;
+    bool OwnsData = true;
+};
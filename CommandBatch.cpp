@@ -0,0 +1,69 @@
+﻿#include "CommandBatch.h"
+
+CommandBatch::CommandBatch(World* Wrld): Wrld(Wrld)
+{
+}
+
+CommandBatch::~CommandBatch()
+{
+    if (Pending == nullptr)
+    {
+        return;
+    }
+    // Only the world may touch its free list, so the reservations go over as a submission of their own
+    for (const Command& Cmd : Pending->Buffer.GetCommands())
+    {
+        if (Cmd.Op == CommandType::Spawn)
+        {
+            Pending->Released.push_back(Cmd.Entity);
+        }
+    }
+    Pending->Buffer.Clear();
+    if (Pending->Released.empty())
+    {
+        Wrld->Allocator.delete_object(Pending);
+        return;
+    }
+    Wrld->Submit(Pending);
+}
+
+EntityID CommandBatch::NewEntity()
+{
+    const EntityID Entity = Wrld->ReserveEntity();
+    GetBuffer()->Spawn(Entity);
+    return Entity;
+}
+
+void CommandBatch::Set(EntityID Entity, ComponentID Type, const void* Data)
+{
+    GetBuffer()->Set(Entity, Type, Data);
+}
+
+void CommandBatch::Remove(EntityID Entity, ComponentID Type)
+{
+    GetBuffer()->Remove(Entity, Type);
+}
+
+void CommandBatch::Delete(EntityID Entity)
+{
+    GetBuffer()->Delete(Entity);
+}
+
+void CommandBatch::Submit()
+{
+    if (Pending == nullptr)
+    {
+        return;
+    }
+    Wrld->Submit(Pending);
+    Pending = nullptr;
+}
+
+CommandBuffer* CommandBatch::GetBuffer()
+{
+    if (Pending == nullptr)
+    {
+        Pending = Wrld->Allocator.new_object<World::SubmittedCommands>(Wrld->Resource);
+    }
+    return &Pending->Buffer;
+}
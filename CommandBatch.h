@@ -0,0 +1,44 @@
+﻿#pragma once
+#include "World.h"
+
+// Records structural changes on a thread that does not own the world, such as a network or AI thread, without
+// touching it. Entity IDs are reserved right away so later commands can refer to them. Submit hands everything
+// recorded so far over in one lock free push and the world applies it at the start of its next Tick.
+// A batch belongs to one thread, give every producer its own. The world must outlive its batches
+class CommandBatch
+{
+public:
+    explicit CommandBatch(World* Wrld);
+
+    // Changes recorded since the last Submit are dropped. Entities they reserved are handed back to the world,
+    // which frees their slots at its next Tick
+    ~CommandBatch();
+    CommandBatch(const CommandBatch& obj) = delete;
+
+    EntityID NewEntity();
+
+    template<typename T>
+    void Set(EntityID Entity, const T& Data)
+    {
+        Set(Entity, GetComponent<T>(), &Data);
+    }
+    void Set(EntityID Entity, ComponentID Type, const void* Data);
+
+    template<typename T>
+    void Remove(EntityID Entity)
+    {
+        Remove(Entity, GetComponent<T>());
+    }
+    void Remove(EntityID Entity, ComponentID Type);
+
+    void Delete(EntityID Entity);
+
+    // The batch can keep recording afterwards, into fresh memory
+    void Submit();
+
+private:
+    CommandBuffer* GetBuffer();
+
+    World* Wrld;
+    World::SubmittedCommands* Pending = nullptr;
+};
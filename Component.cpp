@@ -1,5 +1,188 @@
 ﻿#include "Component.h"
 
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "ErrorHandling.h"
-#include "VectorStorage.h"
 
+// Infos live in fixed size blocks that never move, so lookups take no lock while other threads register types
+static constexpr size_t BlockSize = 256;
+static constexpr size_t MaxBlocks = 1024;
+
+struct ComponentRegistry
+{
+    std::mutex Lock;
+    std::atomic<ComponentInfo*> Blocks[MaxBlocks] = {};
+    std::atomic<size_t> Count = 0;
+    std::unordered_map<uint64_t, ComponentID> ByHash;
+    // Owned copies of the names, the originals may belong to a module that gets unloaded
+    std::deque<std::string> Names;
+    // Released pair slots, handed out again before new ones
+    std::vector<ComponentID> FreePairs;
+
+    ~ComponentRegistry()
+    {
+        for (auto& Block : Blocks)
+        {
+            delete[] Block.load();
+        }
+    }
+};
+
+static ComponentRegistry& GetRegistry()
+{
+    static ComponentRegistry Registry;
+    return Registry;
+}
+
+// The spelling of names in anonymous namespaces or local to a function, which another translation unit may
+// reuse for a different type
+static bool HasInternalLinkage(std::string_view Name)
+{
+    for (std::string_view Marker : {"{anonymous}", "anonymous namespace", ")::", "'::"})
+    {
+        if (Name.find(Marker) != std::string_view::npos)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static ComponentInfo& GetSlot(ComponentRegistry& Registry, ComponentID ID)
+{
+    return Registry.Blocks[ID / BlockSize].load(std::memory_order_acquire)[ID % BlockSize];
+}
+
+// Caller holds the lock
+static ComponentInfo& AddSlot(ComponentRegistry& Registry, const ComponentInfo& Info)
+{
+    const size_t Index = Registry.Count.load(std::memory_order_relaxed);
+    if (Index >= BlockSize * MaxBlocks)
+    {
+        Error("Too many components\n");
+    }
+    if (Index % BlockSize == 0)
+    {
+        Registry.Blocks[Index / BlockSize].store(new ComponentInfo[BlockSize], std::memory_order_release);
+    }
+    ComponentInfo& Stored = GetSlot(Registry, static_cast<ComponentID>(Index));
+    Stored = Info;
+    Stored.ID = static_cast<ComponentID>(Index);
+    Registry.Count.store(Index + 1, std::memory_order_release);
+    return Stored;
+}
+
+ComponentID RegisterComponent(const ComponentInfo& Info)
+{
+    if (Info.Name.empty())
+    {
+        Error("Components need a name to register\n");
+    }
+    ComponentRegistry& Registry = GetRegistry();
+    std::lock_guard<std::mutex> Guard(Registry.Lock);
+    auto Found = Registry.ByHash.find(Info.NameHash);
+    if (Found != Registry.ByHash.end())
+    {
+        const ComponentInfo& Known = GetSlot(Registry, Found->second);
+        if (Known.Name != Info.Name)
+        {
+            Error("Component names %.*s and %.*s hash the same\n", static_cast<int>(Known.Name.size()), Known.Name.data(),
+                static_cast<int>(Info.Name.size()), Info.Name.data());
+        }
+        if (Known.Size != Info.Size || Known.Alignment != Info.Alignment || Known.FieldCount != Info.FieldCount
+            || Known.TriviallyCopyable != Info.TriviallyCopyable || Known.Sparse != Info.Sparse
+            || Known.Tag != Info.Tag)
+        {
+            Error("Component %.*s registered again with a different layout\n", static_cast<int>(Info.Name.size()),
+                Info.Name.data());
+        }
+        if (Known.TypeKey != Info.TypeKey && HasInternalLinkage(Info.Name))
+        {
+            Error("Distinct types share the name %.*s, give one a ComponentName\n",
+                static_cast<int>(Info.Name.size()), Info.Name.data());
+        }
+        return Found->second;
+    }
+
+    ComponentInfo& Stored = AddSlot(Registry, Info);
+    Stored.Name = Registry.Names.emplace_back(Info.Name);
+    Registry.ByHash.emplace(Info.NameHash, Stored.ID);
+    return Stored.ID;
+}
+
+ComponentID AcquirePairComponent(ComponentID Relation, EntityID Target)
+{
+    const ComponentInfo& RelationInfo = GetComponentInfo(Relation);
+    if (!RelationInfo.Tag || RelationInfo.Relation != InvalidComponentID)
+    {
+        Error("Relation %d must be an empty component\n", Relation);
+    }
+    // Named after the relation but not findable by it, the pair is only known to the world owning it
+    ComponentInfo Info = RelationInfo;
+    Info.Relation = Relation;
+    Info.Target = Target;
+    Info.Save = nullptr;
+    Info.Load = nullptr;
+    ComponentRegistry& Registry = GetRegistry();
+    std::lock_guard<std::mutex> Guard(Registry.Lock);
+    if (Registry.FreePairs.empty())
+    {
+        return AddSlot(Registry, Info).ID;
+    }
+    Info.ID = Registry.FreePairs.back();
+    Registry.FreePairs.pop_back();
+    GetSlot(Registry, Info.ID) = Info;
+    return Info.ID;
+}
+
+void ReleasePairComponent(ComponentID Pair)
+{
+    if (GetComponentInfo(Pair).Relation == InvalidComponentID)
+    {
+        Error("Component %d is not a pair\n", Pair);
+    }
+    ComponentRegistry& Registry = GetRegistry();
+    std::lock_guard<std::mutex> Guard(Registry.Lock);
+    ComponentInfo& Info = GetSlot(Registry, Pair);
+    Info.Relation = InvalidComponentID;
+    Info.Target = 0;
+    Registry.FreePairs.push_back(Pair);
+}
+
+ComponentID FindComponent(uint64_t NameHash)
+{
+    ComponentRegistry& Registry = GetRegistry();
+    std::lock_guard<std::mutex> Guard(Registry.Lock);
+    auto Found = Registry.ByHash.find(NameHash);
+    return Found == Registry.ByHash.end() ? InvalidComponentID : Found->second;
+}
+
+size_t GetComponentCount()
+{
+    return GetRegistry().Count.load(std::memory_order_acquire);
+}
+
+void SetSnapshotHooks(ComponentID ID, void (*Save)(SnapshotWriter&, const void*),
+    void (*Load)(SnapshotReader&, void*))
+{
+    GetComponentInfo(ID);
+    ComponentRegistry& Registry = GetRegistry();
+    std::lock_guard<std::mutex> Guard(Registry.Lock);
+    ComponentInfo& Info = GetSlot(Registry, ID);
+    Info.Save = Save;
+    Info.Load = Load;
+}
+
+const ComponentInfo& GetComponentInfo(ComponentID ID)
+{
+    ComponentRegistry& Registry = GetRegistry();
+    if (ID < 0 || static_cast<size_t>(ID) >= Registry.Count.load(std::memory_order_acquire))
+    {
+        Error("Unknown component %d\n", ID);
+    }
+    return GetSlot(Registry, ID);
+}
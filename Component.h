@@ -1,13 +1,228 @@
 ﻿#pragma once
 
-#include <functional>
-#include <unordered_map>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 #include "Types.h"
-#include "VectorStorage.h"
 
-class IStorage;
+class SnapshotReader;
+class SnapshotWriter;
+
+// Everything storage needs to handle a component without knowing its type.
+// The function pointers are only used for types that are not trivially copyable, the rest is moved with memcpy
+struct ComponentInfo
+{
+    // Dense index used by signatures and archetypes, in registration order so it differs between processes
+    ComponentID ID = InvalidComponentID;
+    // Stable identity, the same in every binary that names the type the same way. Snapshots store this
+    std::string_view Name;
+    uint64_t NameHash = 0;
+    // Unique to the type within one module. Types with internal linkage may share a spelled name, this tells them
+    // apart
+    const void* TypeKey = nullptr;
+    size_t Size = 0;
+    size_t Alignment = 0;
+    bool TriviallyCopyable = true;
+    // Non zero for components stored as one array per field, see ComponentFields
+    size_t FieldCount = 0;
+    size_t FieldSize = 0;
+    // Kept in a SparseSet outside the archetypes, see ComponentStorage
+    bool Sparse = false;
+    // Empty type kept only in archetype signatures, with no column and nothing to copy when entities move
+    bool Tag = false;
+    // Set for relationship pairs, the tag standing for Relation pointing at Target. See World::AddPair
+    ComponentID Relation = InvalidComponentID;
+    EntityID Target = 0;
+    // Sources of this relation, or of its pairs, are deleted along with their target instead of losing the pair
+    bool Cascade = false;
+
+    void (*DefaultConstruct)(void* Dst, size_t Count) = nullptr;
+    void (*CopyConstruct)(void* Dst, const void* Src) = nullptr;
+    void (*MoveConstruct)(void* Dst, void* Src) = nullptr;
+    void (*CopyAssign)(void* Dst, const void* Src) = nullptr;
+    void (*Destroy)(void* Ptr, size_t Count) = nullptr;
+
+    // Snapshot hooks, only needed when the component is not trivially copyable. Load overwrites a live value
+    void (*Save)(SnapshotWriter& Out, const void* Value) = nullptr;
+    void (*Load)(SnapshotReader& In, void* Value) = nullptr;
+};
 
 struct Wrapper
 {
 };
+
+// Specialize to store a component split into one array per field, so loops over a single field are contiguous
+// and vectorize. The component must be trivially copyable and made of Count fields of type Type without padding:
+//   template<> struct ComponentFields<Position> { using Type = float; static constexpr size_t Count = 2; };
+// Split components have no per row address, systems reach them through FieldSpans
+template<typename T>
+struct ComponentFields
+{
+    using Type = void;
+    static constexpr size_t Count = 0;
+};
+
+template<typename T>
+constexpr bool IsSplitComponent = ComponentFields<std::remove_const_t<T>>::Count > 0;
+
+// Specialize to keep a component in a sparse set beside the archetypes instead of in their rows, so adding and
+// removing it never moves the entity. Suits markers and states toggled every few ticks. Systems filter on sparse
+// components row by row, queries and span handlers cannot see them:
+//   template<> struct ComponentStorage<Stunned> { static constexpr bool Sparse = true; };
+template<typename T>
+struct ComponentStorage
+{
+    static constexpr bool Sparse = false;
+};
+
+template<typename T>
+constexpr bool IsSparseComponent = ComponentStorage<std::remove_const_t<T>>::Sparse;
+
+// Empty components are tags. Systems get them as spans that are always empty, or rows sharing a single instance
+template<typename T>
+constexpr bool IsTagComponent = std::is_empty_v<std::remove_const_t<T>>
+    && std::is_trivially_copyable_v<std::remove_const_t<T>> && !IsSparseComponent<T>;
+
+// Specialize for a relation whose sources are deleted along with their target:
+//   template<> struct RelationPolicy<Owns> { static constexpr bool Cascade = true; };
+template<typename T>
+struct RelationPolicy
+{
+    static constexpr bool Cascade = false;
+};
+
+// Relation of children to their parent. Deleting a parent deletes its children
+struct ChildOf
+{
+};
+
+template<>
+struct RelationPolicy<ChildOf>
+{
+    static constexpr bool Cascade = true;
+};
+
+// Type name as spelled by the compiler, so it matches across binaries built by the same compiler
+template<typename T>
+constexpr std::string_view GetTypeName()
+{
+#if defined(_MSC_VER)
+    constexpr std::string_view Signature = __FUNCSIG__;
+    constexpr size_t Start = Signature.find("GetTypeName<") + 12;
+    constexpr size_t End = Signature.rfind(">(void)");
+#else
+    constexpr std::string_view Signature = __PRETTY_FUNCTION__;
+    constexpr size_t Start = Signature.find("T = ") + 4;
+    constexpr size_t End = Signature.find_first_of(";]", Start);
+#endif
+    return Signature.substr(Start, End - Start);
+}
+
+// Name a component registers under. Specialize to keep its identity when the type is renamed or moved, or when
+// binaries from different compilers share snapshots:
+//   template<> struct ComponentName<Position> { static constexpr std::string_view Value = "Position"; };
+template<typename T>
+struct ComponentName
+{
+    static constexpr std::string_view Value = GetTypeName<T>();
+};
+
+// 64 bit FNV-1a
+constexpr uint64_t HashComponentName(std::string_view Name)
+{
+    uint64_t Hash = 0xcbf29ce484222325ull;
+    for (char Char : Name)
+    {
+        Hash = (Hash ^ static_cast<uint8_t>(Char)) * 0x100000001b3ull;
+    }
+    return Hash;
+}
+
+// Compile time identity of a component, unlike its ComponentID
+template<typename T>
+constexpr uint64_t ComponentTypeHash = HashComponentName(ComponentName<std::remove_cv_t<T>>::Value);
+
+// Thread safe. Registering a name again, for example from another module, returns the ID it already has as long
+// as the layout matches. Names of types with internal linkage, in an anonymous namespace or local to a function,
+// must also come from the same type
+ComponentID RegisterComponent(const ComponentInfo& Info);
+// Thread safe. A fresh tag standing for the pair (Relation, Target), owned by the caller until released, after
+// which its ID goes to a later pair. Relation must be a tag. Worlds keep their own pairs, see World::AddPair
+ComponentID AcquirePairComponent(ComponentID Relation, EntityID Target);
+void ReleasePairComponent(ComponentID Pair);
+// InvalidComponentID if no component with that name hash is registered
+ComponentID FindComponent(uint64_t NameHash);
+const ComponentInfo& GetComponentInfo(ComponentID ID);
+size_t GetComponentCount();
+void SetSnapshotHooks(ComponentID ID, void (*Save)(SnapshotWriter&, const void*),
+    void (*Load)(SnapshotReader&, void*));
+
+template<typename T>
+ComponentInfo MakeComponentInfo()
+{
+    ComponentInfo Info;
+    Info.Name = ComponentName<T>::Value;
+    Info.NameHash = ComponentTypeHash<T>;
+    Info.Size = sizeof(T);
+    Info.Alignment = alignof(T);
+    static constexpr char Key = 0;
+    Info.TypeKey = &Key;
+    Info.TriviallyCopyable = std::is_trivially_copyable_v<T>;
+    if constexpr (IsSplitComponent<T>)
+    {
+        using Field = typename ComponentFields<T>::Type;
+        static_assert(std::is_trivially_copyable_v<T>, "Split components must be trivially copyable");
+        static_assert(sizeof(T) == sizeof(Field) * ComponentFields<T>::Count, "Split components must be packed fields");
+        static_assert(!IsSparseComponent<T>, "Split components cannot be sparse");
+        Info.FieldCount = ComponentFields<T>::Count;
+        Info.FieldSize = sizeof(Field);
+    }
+    Info.Sparse = IsSparseComponent<T>;
+    Info.Tag = IsTagComponent<T>;
+    Info.Cascade = RelationPolicy<std::remove_const_t<T>>::Cascade;
+    if constexpr (!std::is_trivially_copyable_v<T>)
+    {
+        Info.DefaultConstruct = [](void* Dst, size_t Count)
+        {
+            for (size_t i = 0; i < Count; i++)
+            {
+                new (static_cast<T*>(Dst) + i) T();
+            }
+        };
+        Info.CopyConstruct = [](void* Dst, const void* Src) { new (Dst) T(*static_cast<const T*>(Src)); };
+        Info.MoveConstruct = [](void* Dst, void* Src) { new (Dst) T(std::move(*static_cast<T*>(Src))); };
+        Info.CopyAssign = [](void* Dst, const void* Src) { *static_cast<T*>(Dst) = *static_cast<const T*>(Src); };
+        Info.Destroy = [](void* Ptr, size_t Count)
+        {
+            for (size_t i = 0; i < Count; i++)
+            {
+                static_cast<T*>(Ptr)[i].~T();
+            }
+        };
+    }
+    return Info;
+}
+
+// Constant initialized, so reading it needs no static init guard. Every module caching its own copy is fine since
+// registration hands them all the same ID
+template<typename T>
+inline std::atomic<ComponentID> CachedComponentID{InvalidComponentID};
+
+// A const qualified type is the same component as the plain one
+template<typename T>
+ComponentID GetComponent()
+{
+    using Type = std::remove_cv_t<T>;
+    ComponentID Cmp = CachedComponentID<Type>.load(std::memory_order_acquire);
+    if (Cmp == InvalidComponentID)
+    {
+        Cmp = RegisterComponent(MakeComponentInfo<Type>());
+        CachedComponentID<Type>.store(Cmp, std::memory_order_release);
+    }
+    return Cmp;
+}
@@ -29,18 +29,11 @@ int Movement()
     E2.Set<Position>({2, 0})
         .Set<Velocity>({-1.1f, -0.2f});
     
-    Wld.AddSystem({
-        {
-            GetComponent<Position>(),
-            GetComponent<Velocity>()
-        },
-        [](World* w, Entity e)
-        {
-            auto Pos = e.Get<Position>();
-            auto Vel = e.Get<Velocity>();
-            Pos->X += Vel->X;
-            Pos->Y += Vel->Y;
-        }});
+    Wld.AddSystem<Position, Velocity>([](Position& Pos, const Velocity& Vel)
+    {
+        Pos.X += Vel.X;
+        Pos.Y += Vel.Y;
+    });
     
     Wld.AddSystem({
         {
@@ -49,7 +42,7 @@ int Movement()
         [](World* w, Entity e)
         {
             auto Pos = e.Get<Position>();
-            Trace("Data for %d: %f, %f\n", e.GetID(), Pos->X, Pos->Y);
+            Trace("Data for %u: %f, %f\n", GetEntityIndex(e.GetID()), Pos->X, Pos->Y);
         }});
 
     Wld.AddSystem({
@@ -62,7 +55,7 @@ int Movement()
             if(Pos->X > 10 || Pos->X < -10
                 ||Pos->Y > 10 || Pos->Y < -10)
             {
-                Trace("Killing %d\n", e.GetID());
+                Trace("Killing %u\n", GetEntityIndex(e.GetID()));
                 w->NewEntity()
                     .Set<Position>({0, 1})
                     .Set<Velocity>({1, -0.5});
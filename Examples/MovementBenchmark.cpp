@@ -0,0 +1,147 @@
+﻿#include "MovementBenchmark.h"
+#include <chrono>
+#include <cstdio>
+#include <span>
+
+#include "../World.h"
+
+struct BenchPosition
+{
+    float X;
+    float Y;
+};
+
+struct BenchVelocity
+{
+    float X;
+    float Y;
+};
+
+// Same data again, stored as one array per field
+struct SplitPosition
+{
+    float X;
+    float Y;
+};
+
+struct SplitVelocity
+{
+    float X;
+    float Y;
+};
+
+template<>
+struct ComponentFields<SplitPosition>
+{
+    using Type = float;
+    static constexpr size_t Count = 2;
+};
+
+template<>
+struct ComponentFields<SplitVelocity>
+{
+    using Type = float;
+    static constexpr size_t Count = 2;
+};
+
+static constexpr int Ticks = 200;
+
+static void Report(const char* Name, World& Wld, size_t EntityCount, float Checksum(World&))
+{
+    const auto Start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Ticks; i++)
+    {
+        Wld.Tick();
+    }
+    const std::chrono::duration<double, std::nano> Elapsed = std::chrono::steady_clock::now() - Start;
+    printf("%-24s %8.3f ms/tick %7.3f ns/entity  (checksum %.1f)\n", Name, Elapsed.count() / Ticks / 1e6,
+        Elapsed.count() / Ticks / EntityCount, Checksum(Wld));
+}
+
+static float SumPositions(World& Wld)
+{
+    float Sum = 0;
+    Wld.ParallelForEach<const BenchPosition>([&](std::span<const BenchPosition> Pos)
+    {
+        for (const auto& P : Pos)
+        {
+            Sum += P.X + P.Y;
+        }
+    });
+    return Sum;
+}
+
+static float SumSplitPositions(World& Wld)
+{
+    float Sum = 0;
+    Wld.ParallelForEach<const SplitPosition>([&](FieldSpans<const SplitPosition> Pos)
+    {
+        for (size_t i = 0; i < Pos.size(); i++)
+        {
+            Sum += Pos[0][i] + Pos[1][i];
+        }
+    });
+    return Sum;
+}
+
+static void RowPath(size_t EntityCount, size_t ChunkBytes)
+{
+    World Wld({1, ChunkBytes});
+    Wld.SpawnPrefab(EntityCount, BenchPosition{0, 0}, BenchVelocity{1.0f, 0.5f});
+    // What the Movement example does
+    Wld.AddSystem<BenchPosition, const BenchVelocity>([](BenchPosition& Pos, const BenchVelocity& Vel)
+    {
+        Pos.X += Vel.X;
+        Pos.Y += Vel.Y;
+    });
+    Report(ChunkBytes == 0 ? "rows" : "rows, chunked", Wld, EntityCount, SumPositions);
+}
+
+static void SpanPath(size_t EntityCount, size_t ChunkBytes)
+{
+    World Wld({1, ChunkBytes});
+    Wld.SpawnPrefab(EntityCount, BenchPosition{0, 0}, BenchVelocity{1.0f, 0.5f});
+    Wld.AddSystem<BenchPosition, const BenchVelocity>(
+        [](std::span<BenchPosition> Pos, std::span<const BenchVelocity> Vel)
+    {
+        for (size_t i = 0; i < Pos.size(); i++)
+        {
+            Pos[i].X += Vel[i].X;
+            Pos[i].Y += Vel[i].Y;
+        }
+    });
+    Report(ChunkBytes == 0 ? "spans" : "spans, chunked", Wld, EntityCount, SumPositions);
+}
+
+static void SplitPath(size_t EntityCount, size_t ChunkBytes)
+{
+    World Wld({1, ChunkBytes});
+    Wld.SpawnPrefab(EntityCount, SplitPosition{0, 0}, SplitVelocity{1.0f, 0.5f});
+    Wld.AddSystem<SplitPosition, const SplitVelocity>(
+        [](FieldSpans<SplitPosition> Pos, FieldSpans<const SplitVelocity> Vel)
+    {
+        // Each field is a plain float array, so the loop vectorizes without any gather
+        for (size_t Field = 0; Field < Pos.FieldCount; Field++)
+        {
+            std::span<float> P = Pos[Field];
+            std::span<const float> V = Vel[Field];
+            for (size_t i = 0; i < P.size(); i++)
+            {
+                P[i] += V[i];
+            }
+        }
+    });
+    Report(ChunkBytes == 0 ? "split fields" : "split fields, chunked", Wld, EntityCount, SumSplitPositions);
+}
+
+int MovementBenchmark(size_t EntityCount)
+{
+    printf("Movement over %zu entities, %d ticks\n", EntityCount, Ticks);
+    for (size_t ChunkBytes : {size_t(0), size_t(16 * 1024)})
+    {
+        RowPath(EntityCount, ChunkBytes);
+        SpanPath(EntityCount, ChunkBytes);
+        SplitPath(EntityCount, ChunkBytes);
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+﻿#pragma once
+#include <cstddef>
+
+// Times the Movement integration step over EntityCount entities, row by row and with the span kernels
+int MovementBenchmark(size_t EntityCount = 1000000);
@@ -0,0 +1,34 @@
+﻿#pragma once
+#include <cstddef>
+#include <span>
+#include <type_traits>
+
+#include "Component.h"
+
+// Rows of a split component as one span per field, see ComponentFields. Const T gives read only fields
+template<typename T>
+class FieldSpans
+{
+public:
+    using FieldType = std::conditional_t<std::is_const_v<T>,
+        const typename ComponentFields<std::remove_const_t<T>>::Type,
+        typename ComponentFields<std::remove_const_t<T>>::Type>;
+    static constexpr size_t FieldCount = ComponentFields<std::remove_const_t<T>>::Count;
+
+    FieldSpans(FieldType* First, size_t Stride, size_t Count): First(First), Stride(Stride), Count(Count)
+    {
+    }
+
+    std::span<FieldType> operator[](size_t Field) const { return {First + Field * Stride, Count}; }
+    size_t size() const { return Count; }
+
+private:
+    FieldType* First;
+    // Elements between the starts of two fields
+    size_t Stride;
+    size_t Count;
+};
+
+// What a span handler receives for component T: field spans for split components, a plain span otherwise
+template<typename T>
+using ColumnSpan = std::conditional_t<IsSplitComponent<T>, FieldSpans<T>, std::span<T>>;
@@ -0,0 +1,53 @@
+﻿#include "Query.h"
+
+#include <algorithm>
+
+Query::Query(const ArchSignature& All, const ArchSignature& Any, const ArchSignature& None):
+    All(All),
+    Any(Any),
+    None(None)
+{
+}
+
+bool Query::Matches(const ArchSignature& Signature) const
+{
+    return Signature.ContainsAll(All)
+        && (Any.IsEmpty() || Signature.Intersects(Any))
+        && !Signature.Intersects(None);
+}
+
+size_t Query::GetEntityCount() const
+{
+    size_t Count = 0;
+    for (auto Arch : MatchedArchetypes)
+    {
+        Count += Arch->GetEntityCount();
+    }
+    return Count;
+}
+
+void Query::RemoveMatch(Archetype* Arch)
+{
+    // A new archetype may be allocated at the same address
+    if (Arch == LastTested)
+    {
+        LastTested = nullptr;
+    }
+    if (Matches(*Arch->GetSignature()))
+    {
+        MatchedArchetypes.erase(std::find(MatchedArchetypes.begin(), MatchedArchetypes.end(), Arch));
+    }
+}
+
+void Query::TryAddMatch(Archetype* Arch)
+{
+    if (Arch == LastTested)
+    {
+        return;
+    }
+    LastTested = Arch;
+    if (Matches(*Arch->GetSignature()))
+    {
+        MatchedArchetypes.emplace_back(Arch);
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <vector>
+
+#include "Archetype.h"
+
+// Cached list of the archetypes matching a filter, made by World::AddQuery and kept up to date by that world as
+// archetypes appear and are compacted away. An archetype matches when it has every component of All, at least one
+// component of Any unless Any is empty, and no component of None
+class Query
+{
+public:
+    Query(const ArchSignature& All, const ArchSignature& Any, const ArchSignature& None);
+    Query(const Query& obj) = delete;
+
+    bool Matches(const ArchSignature& Signature) const;
+
+    const ArchSignature& GetAll() const { return All; }
+    const ArchSignature& GetAny() const { return Any; }
+    const ArchSignature& GetNone() const { return None; }
+
+    // In the order the archetypes were made
+    const std::vector<Archetype*>& GetMatchedArchetypes() const { return MatchedArchetypes; }
+    size_t GetEntityCount() const;
+
+private:
+    friend class World;
+
+    void TryAddMatch(Archetype* Arch);
+    // Forgets an archetype about to be destroyed
+    void RemoveMatch(Archetype* Arch);
+
+    const ArchSignature All;
+    const ArchSignature Any;
+    const ArchSignature None;
+    std::vector<Archetype*> MatchedArchetypes;
+    // Queries indexed under several components are offered a new archetype once per component it has
+    Archetype* LastTested = nullptr;
+};
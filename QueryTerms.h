@@ -0,0 +1,118 @@
+﻿#pragma once
+#include <span>
+#include <type_traits>
+
+#include "ChangeFilters.h"
+#include "FieldSpans.h"
+
+// Match terms for typed systems and queries. With<T> only visits archetypes having T without handing T to the
+// handler, Without<T> never visits archetypes having T, and Optional<T> visits archetypes whether or not they
+// have T. Archetypes are sorted out once when they are matched, never per row
+template<typename T>
+struct With
+{
+};
+
+template<typename T>
+struct Without
+{
+};
+
+// Row handlers take Optional<T> as T*, null where the archetype lacks T. Span handlers take a std::span<T> that
+// is empty where the archetype lacks T. Split components cannot be optional
+template<typename T>
+struct Optional
+{
+};
+
+template<typename T>
+struct MatchTerm
+{
+    using Type = T;
+    static constexpr bool IsWith = false;
+    static constexpr bool IsWithout = false;
+    static constexpr bool IsOptional = false;
+};
+
+template<typename T>
+struct MatchTerm<With<T>>
+{
+    using Type = T;
+    static constexpr bool IsWith = true;
+    static constexpr bool IsWithout = false;
+    static constexpr bool IsOptional = false;
+};
+
+template<typename T>
+struct MatchTerm<Without<T>>
+{
+    using Type = T;
+    static constexpr bool IsWith = false;
+    static constexpr bool IsWithout = true;
+    static constexpr bool IsOptional = false;
+};
+
+template<typename T>
+struct MatchTerm<Optional<T>>
+{
+    using Type = T;
+    static constexpr bool IsWith = false;
+    static constexpr bool IsWithout = false;
+    static constexpr bool IsOptional = true;
+    static_assert(!IsSplitComponent<T>, "Components split into fields cannot be optional");
+};
+
+template<typename T>
+constexpr bool IsMatchTerm = MatchTerm<T>::IsWith || MatchTerm<T>::IsWithout || MatchTerm<T>::IsOptional;
+
+// Terms handed to the handler: everything but With and Without, change filters stripped
+template<typename T>
+constexpr bool IsDataTerm = !MatchTerm<Unfiltered<T>>::IsWith && !MatchTerm<Unfiltered<T>>::IsWithout;
+
+// Component a term refers to, every wrapper and constness stripped
+template<typename T>
+using TermComponent = std::remove_const_t<typename MatchTerm<Unfiltered<T>>::Type>;
+
+template<typename... Ts>
+struct TermList
+{
+};
+
+template<typename List, typename... Ts>
+struct CollectDataTerms;
+
+template<typename... Done>
+struct CollectDataTerms<TermList<Done...>>
+{
+    using Type = TermList<Done...>;
+};
+
+template<typename... Done, typename T, typename... Rest>
+struct CollectDataTerms<TermList<Done...>, T, Rest...>
+{
+    using Type = typename CollectDataTerms<
+        std::conditional_t<IsDataTerm<T>, TermList<Done..., Unfiltered<T>>, TermList<Done...>>, Rest...>::Type;
+};
+
+template<typename... Ts>
+using DataTerms = typename CollectDataTerms<TermList<>, Ts...>::Type;
+
+// Row of an optional column, null for the whole archetype when it lacks the component
+template<typename T>
+struct OptionalColumn
+{
+    T* Data;
+};
+
+// What span handlers take for a data term
+template<typename T>
+struct TermAccess
+{
+    using Span = ColumnSpan<T>;
+};
+
+template<typename T>
+struct TermAccess<Optional<T>>
+{
+    using Span = std::span<T>;
+};
@@ -0,0 +1,29 @@
+﻿#include "Scheduler.h"
+
+void Scheduler::Build(const std::vector<System>& Systems)
+{
+    Stages.clear();
+    std::vector<size_t> StageOf(Systems.size(), 0);
+    for (size_t i = 0; i < Systems.size(); i++)
+    {
+        size_t Stage = 0;
+        for (size_t j = 0; j < i; j++)
+        {
+            if (StageOf[j] + 1 > Stage && Systems[i].ConflictsWith(Systems[j]))
+            {
+                Stage = StageOf[j] + 1;
+            }
+        }
+        StageOf[i] = Stage;
+        if (Stage == Stages.size())
+        {
+            Stages.emplace_back();
+        }
+        Stages[Stage].push_back(i);
+    }
+}
+
+const std::vector<std::vector<size_t>>& Scheduler::GetStages() const
+{
+    return Stages;
+}
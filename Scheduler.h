@@ -0,0 +1,19 @@
+﻿#pragma once
+#include <vector>
+
+#include "System.h"
+
+// Groups systems into stages of mutually non-conflicting systems. A system is placed in the stage after the
+// last earlier registered system it conflicts with, so conflicting systems always keep registration order and
+// the plan only depends on what was registered, never on thread count or timing.
+class Scheduler
+{
+public:
+    void Build(const std::vector<System>& Systems);
+
+    // Each stage lists system indices in registration order
+    const std::vector<std::vector<size_t>>& GetStages() const;
+
+private:
+    std::vector<std::vector<size_t>> Stages;
+};
@@ -1,8 +1,11 @@
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #include "Entity.h"
 #include "World.h"
 #include "Examples/MoveSystem.h"
+#include "Examples/MovementBenchmark.h"
 
 struct MyData
 {
@@ -13,8 +16,12 @@ struct MyData
     float X5;
 };
 
-int main()
+int main(int argc, char** argv)
 {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        return argc > 2 ? MovementBenchmark(strtoull(argv[2], nullptr, 10)) : MovementBenchmark();
+    }
     Movement();
     
     return 0;
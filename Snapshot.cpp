@@ -0,0 +1,1003 @@
+﻿#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ErrorHandling.h"
+#include "Tracing.h"
+#include "World.h"
+
+// Column and entity blocks start on a cache line of the file, which mmap places on a page
+static constexpr size_t BlockAlignment = 64;
+
+struct SnapshotHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    // Entity slots in use so far, every slot below this has its generation saved
+    uint32_t SlotCount;
+    uint32_t FreeCount;
+    uint32_t ArchetypeCount;
+    // Sparse component pools, saved after the archetypes as records of a single column
+    uint32_t SparseCount;
+};
+
+// Followed by one ColumnRecord per component, then the entity ID block and one block per column. Tags have a
+// record but no column
+struct ArchetypeRecord
+{
+    uint32_t ComponentCount;
+    uint32_t Reserved;
+    uint64_t RowCount;
+};
+
+// Components are named by their name hash, IDs depend on registration order and differ between processes.
+// Relationship pairs are named by their relation and target
+struct ColumnRecord
+{
+    uint64_t NameHash;
+    EntityID Target;
+    // Zero for tags
+    uint32_t Size;
+    uint32_t FieldCount;
+    // Written through the component's save hook rather than as raw rows
+    uint32_t Hooked;
+    uint32_t Reserved;
+};
+
+SnapshotWriter::SnapshotWriter(FILE* File): File(File)
+{
+}
+
+SnapshotWriter::SnapshotWriter(std::vector<uint8_t>& Buffer): Buffer(&Buffer), Base(Buffer.size())
+{
+}
+
+void SnapshotWriter::WriteBytes(const void* Data, size_t Bytes)
+{
+    if (Buffer != nullptr)
+    {
+        const uint8_t* Begin = static_cast<const uint8_t*>(Data);
+        Buffer->insert(Buffer->end(), Begin, Begin + Bytes);
+    }
+    else if (Bytes > 0 && fwrite(Data, 1, Bytes, File) != Bytes)
+    {
+        Failed = true;
+    }
+    Offset += Bytes;
+}
+
+void SnapshotWriter::Pad(size_t Alignment)
+{
+    static const uint8_t Zeros[BlockAlignment] = {};
+    while (Offset % Alignment != 0)
+    {
+        WriteBytes(Zeros, std::min(Alignment - Offset % Alignment, sizeof(Zeros)));
+    }
+}
+
+void SnapshotWriter::Patch(size_t At, const void* Data, size_t Bytes)
+{
+    if (Buffer != nullptr)
+    {
+        memcpy(Buffer->data() + Base + At, Data, Bytes);
+        return;
+    }
+    if (fseek(File, static_cast<long>(At), SEEK_SET) != 0
+        || fwrite(Data, 1, Bytes, File) != Bytes
+        || fseek(File, 0, SEEK_END) != 0)
+    {
+        Failed = true;
+    }
+}
+
+SnapshotReader::SnapshotReader(const uint8_t* Begin, const uint8_t* End): Cursor(Begin), End(End)
+{
+}
+
+void SnapshotReader::ReadBytes(void* Out, size_t Bytes)
+{
+    const uint8_t* Data = Take(Bytes);
+    if (Data == nullptr)
+    {
+        Error("Snapshot read of %zu bytes past the end of its block\n", Bytes);
+    }
+    memcpy(Out, Data, Bytes);
+}
+
+const uint8_t* SnapshotReader::Take(size_t Bytes)
+{
+    if (Bytes > GetRemaining())
+    {
+        return nullptr;
+    }
+    const uint8_t* Data = Cursor;
+    Cursor += Bytes;
+    return Data;
+}
+
+bool SnapshotReader::Align(const uint8_t* Origin, size_t Alignment)
+{
+    const size_t Offset = static_cast<size_t>(Cursor - Origin);
+    return Take((Alignment - Offset % Alignment) % Alignment) != nullptr;
+}
+
+// Read only view of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const char* Path)
+    {
+#ifdef _WIN32
+        HANDLE File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        LARGE_INTEGER FileSize;
+        if (GetFileSizeEx(File, &FileSize) && FileSize.QuadPart > 0)
+        {
+            Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (Mapping != nullptr)
+            {
+                Data = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+                Size = Data != nullptr ? static_cast<size_t>(FileSize.QuadPart) : 0;
+            }
+        }
+        CloseHandle(File);
+#else
+        const int File = open(Path, O_RDONLY);
+        if (File < 0)
+        {
+            return;
+        }
+        struct stat Stat;
+        if (fstat(File, &Stat) == 0 && Stat.st_size > 0)
+        {
+            void* View = mmap(nullptr, static_cast<size_t>(Stat.st_size), PROT_READ, MAP_PRIVATE, File, 0);
+            if (View != MAP_FAILED)
+            {
+                madvise(View, static_cast<size_t>(Stat.st_size), MADV_SEQUENTIAL);
+                Data = static_cast<const uint8_t*>(View);
+                Size = static_cast<size_t>(Stat.st_size);
+            }
+        }
+        close(File);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (Data != nullptr)
+        {
+            UnmapViewOfFile(Data);
+        }
+        if (Mapping != nullptr)
+        {
+            CloseHandle(Mapping);
+        }
+#else
+        if (Data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(Data), Size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile& obj) = delete;
+
+    const uint8_t* GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+
+private:
+#ifdef _WIN32
+    HANDLE Mapping = nullptr;
+#endif
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+};
+
+template<typename T>
+static bool ReadRecord(SnapshotReader& In, T& Out)
+{
+    const uint8_t* Data = In.Take(sizeof(T));
+    if (Data == nullptr)
+    {
+        return false;
+    }
+    memcpy(&Out, Data, sizeof(T));
+    return true;
+}
+
+// Blocks are their byte count, padding up to the block alignment and then the bytes themselves
+template<typename Func>
+static void WriteBlock(SnapshotWriter& Out, const Func& Body)
+{
+    const size_t CountAt = Out.GetOffset();
+    Out.Write<uint64_t>(0);
+    Out.Pad(BlockAlignment);
+    const size_t Begin = Out.GetOffset();
+    Body();
+    const uint64_t Bytes = Out.GetOffset() - Begin;
+    Out.Patch(CountAt, &Bytes, sizeof(Bytes));
+}
+
+static const uint8_t* ReadBlock(SnapshotReader& In, const uint8_t* Origin, uint64_t& Bytes)
+{
+    if (!ReadRecord(In, Bytes) || !In.Align(Origin, BlockAlignment) || Bytes > In.GetRemaining())
+    {
+        return nullptr;
+    }
+    return In.Take(static_cast<size_t>(Bytes));
+}
+
+static void CheckSnapshotHooks(const Archetype& Arch)
+{
+    for (const auto Type : *Arch.GetSignature())
+    {
+        const ComponentInfo& Info = GetComponentInfo(Type);
+        if (!Info.TriviallyCopyable && (Info.Save == nullptr || Info.Load == nullptr))
+        {
+            Error("Component %d is not trivially copyable and has no snapshot hooks\n", Type);
+        }
+    }
+}
+
+// In signature order, so leaving out the tags gives the column order
+static void WriteColumnRecords(SnapshotWriter& Out, const Archetype& Arch)
+{
+    for (const auto Type : *Arch.GetSignature())
+    {
+        const ComponentInfo& Info = GetComponentInfo(Type);
+        const uint64_t NameHash = Info.Target != 0 ? GetComponentInfo(Info.Relation).NameHash : Info.NameHash;
+        Out.Write(ColumnRecord{NameHash, Info.Target, Info.Tag ? 0u : static_cast<uint32_t>(Info.Size),
+            static_cast<uint32_t>(Info.FieldCount), Info.TriviallyCopyable ? 0u : 1u, 0});
+    }
+}
+
+// Reads the component records of one archetype, in the writer's column order which need not be ours. Every
+// component must be registered here with the same layout and storage, false on any mismatch. Infos only gets
+// the components having a column. Pairs are handed back as relation and target for the caller to add once the
+// whole file is accepted, or refused when Pairs is null
+static bool ReadColumnRecords(SnapshotReader& In, uint32_t Count, ArchSignature& Signature,
+    std::vector<const ComponentInfo*>& Infos, std::vector<std::pair<ComponentID, EntityID>>* Pairs,
+    bool Sparse = false)
+{
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        ColumnRecord Desc;
+        if (!ReadRecord(In, Desc))
+        {
+            return false;
+        }
+        const ComponentID Type = FindComponent(Desc.NameHash);
+        if (Type != InvalidComponentID && Desc.Target != 0)
+        {
+            const ComponentInfo& Relation = GetComponentInfo(Type);
+            if (Pairs == nullptr || !Relation.Tag || Relation.Relation != InvalidComponentID || Desc.Size != 0
+                || std::any_of(Pairs->begin(), Pairs->end(), [&](const auto& Pair) { return Pair.first == Type; }))
+            {
+                return false;
+            }
+            Pairs->emplace_back(Type, Desc.Target);
+            continue;
+        }
+        if (Type == InvalidComponentID || Signature.Contains(Type))
+        {
+            return false;
+        }
+        const ComponentInfo& Info = GetComponentInfo(Type);
+        if (Desc.Size != (Info.Tag ? 0 : Info.Size) || Desc.FieldCount != Info.FieldCount || Info.Sparse != Sparse
+            || (Desc.Hooked != 0) != !Info.TriviallyCopyable || (Desc.Hooked != 0 && Info.Load == nullptr))
+        {
+            return false;
+        }
+        Signature.Add(Type);
+        if (!Info.Tag)
+        {
+            Infos.push_back(&Info);
+        }
+    }
+    // A pair always comes with its relation, see World::ChangePair
+    return Pairs == nullptr || std::all_of(Pairs->begin(), Pairs->end(),
+        [&](const auto& Pair) { return Signature.Contains(Pair.first); });
+}
+
+// Whole rows for plain components, one array per field spanning the whole archetype for split ones
+static void WriteColumn(SnapshotWriter& Out, const Archetype& Arch, size_t Index)
+{
+    const ComponentInfo& Info = Arch.GetChunk(0)->GetColumn(Index)->GetInfo();
+    if (!Info.TriviallyCopyable)
+    {
+        for (size_t c = 0; c < Arch.GetChunkCount(); c++)
+        {
+            const Column* Store = Arch.GetChunk(c)->GetColumn(Index);
+            for (size_t Row = 0; Row < Store->GetSize(); Row++)
+            {
+                Info.Save(Out, Store->Get(Row));
+            }
+        }
+        return;
+    }
+    const size_t Fields = Info.FieldCount > 0 ? Info.FieldCount : 1;
+    const size_t RowBytes = Info.FieldCount > 0 ? Info.FieldSize : Info.Size;
+    for (size_t Field = 0; Field < Fields; Field++)
+    {
+        for (size_t c = 0; c < Arch.GetChunkCount(); c++)
+        {
+            Column* Store = Arch.GetChunk(c)->GetColumn(Index);
+            const void* Data = Info.FieldCount > 0 ? Store->GetField(Field) : Store->GetData();
+            Out.WriteBytes(Data, Store->GetSize() * RowBytes);
+        }
+    }
+}
+
+static void WriteSparseValues(SnapshotWriter& Out, Column& Values)
+{
+    const ComponentInfo& Info = Values.GetInfo();
+    if (!Info.TriviallyCopyable)
+    {
+        for (size_t Row = 0; Row < Values.GetSize(); Row++)
+        {
+            Info.Save(Out, Values.Get(Row));
+        }
+        return;
+    }
+    Out.WriteBytes(Values.GetData(), Values.GetSize() * Info.Size);
+}
+
+bool World::SaveSnapshot(const char* Path) const
+{
+    if (WorldLock)
+    {
+        Error("Cannot save a snapshot while world is locked\n");
+    }
+    std::vector<const Archetype*> Saved;
+    for (auto Arch : Archetypes)
+    {
+        if (Arch->GetEntityCount() > 0)
+        {
+            Saved.push_back(Arch);
+        }
+    }
+    for (auto Arch : Saved)
+    {
+        CheckSnapshotHooks(*Arch);
+    }
+    std::vector<SparseSet*> SavedPools;
+    for (auto Pool : SparsePoolList)
+    {
+        const ComponentInfo& Info = Pool->GetValues().GetInfo();
+        if (Pool->GetCount() == 0)
+        {
+            continue;
+        }
+        if (!Info.TriviallyCopyable && (Info.Save == nullptr || Info.Load == nullptr))
+        {
+            Error("Component %d is not trivially copyable and has no snapshot hooks\n", Info.ID);
+        }
+        SavedPools.push_back(Pool);
+    }
+    ECS_TRACE_SCOPE("Save snapshot", Saved.size());
+
+    FILE* File = fopen(Path, "wb");
+    if (File == nullptr)
+    {
+        return false;
+    }
+    SnapshotWriter Out(File);
+    const uint32_t SlotCount = NextSlot;
+    Out.Write(SnapshotHeader{SnapshotMagic, SnapshotVersion, SlotCount, static_cast<uint32_t>(FreeSlots.size()),
+        static_cast<uint32_t>(Saved.size()), static_cast<uint32_t>(SavedPools.size())});
+    for (uint32_t i = 0; i < SlotCount; i++)
+    {
+        Out.Write<uint32_t>(i < Slots.size() ? Slots[i].Generation : 0);
+    }
+    Out.WriteBytes(FreeSlots.data(), FreeSlots.size() * sizeof(uint32_t));
+
+    for (auto Arch : Saved)
+    {
+        const size_t ColumnCount = Arch->GetChunk(0)->GetColumnCount();
+        Out.Write(ArchetypeRecord{static_cast<uint32_t>(Arch->GetSignature()->Count()), 0, Arch->GetEntityCount()});
+        WriteColumnRecords(Out, *Arch);
+        WriteBlock(Out, [&]()
+        {
+            for (size_t c = 0; c < Arch->GetChunkCount(); c++)
+            {
+                const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+                Out.WriteBytes(Chunk->GetEntityIDs(), Chunk->GetCount() * sizeof(EntityID));
+            }
+        });
+        for (size_t Index = 0; Index < ColumnCount; Index++)
+        {
+            WriteBlock(Out, [&]() { WriteColumn(Out, *Arch, Index); });
+        }
+    }
+    for (auto Pool : SavedPools)
+    {
+        const ComponentInfo& Info = Pool->GetValues().GetInfo();
+        Out.Write(ArchetypeRecord{1, 0, Pool->GetCount()});
+        Out.Write(ColumnRecord{Info.NameHash, 0, static_cast<uint32_t>(Info.Size), 0, Info.TriviallyCopyable ? 0u : 1u, 0});
+        WriteBlock(Out, [&]() { Out.WriteBytes(Pool->GetEntityIDs(), Pool->GetCount() * sizeof(EntityID)); });
+        WriteBlock(Out, [&]() { WriteSparseValues(Out, Pool->GetValues()); });
+    }
+    const bool Failed = Out.HasFailed();
+    return fclose(File) == 0 && !Failed;
+}
+
+bool World::LoadSnapshot(const char* Path)
+{
+    if (WorldLock)
+    {
+        Error("Cannot load a snapshot while world is locked\n");
+    }
+    if (NextSlot != 1)
+    {
+        Error("Snapshots can only be loaded into a world that never had entities\n");
+    }
+    MappedFile File(Path);
+    const uint8_t* Origin = File.GetData();
+    SnapshotReader In(Origin, Origin + File.GetSize());
+
+    SnapshotHeader Header;
+    if (!ReadRecord(In, Header) || Header.Magic != SnapshotMagic || Header.Version != SnapshotVersion
+        || Header.SlotCount == 0)
+    {
+        return false;
+    }
+    const uint8_t* Generations = In.Take(Header.SlotCount * sizeof(uint32_t));
+    const uint8_t* Free = In.Take(Header.FreeCount * sizeof(uint32_t));
+    if (Generations == nullptr || Free == nullptr)
+    {
+        return false;
+    }
+
+    // Everything is checked before the world is touched, so a bad file leaves it empty
+    struct ColumnImage
+    {
+        const ComponentInfo* Info;
+        const uint8_t* Data;
+        uint64_t Bytes;
+    };
+    struct ArchetypeImage
+    {
+        ArchSignature Signature;
+        // Relation and target of each pair, only made once the whole file is accepted
+        std::vector<std::pair<ComponentID, EntityID>> Pairs;
+        size_t RowCount;
+        const uint8_t* IDs;
+        // Sorted into archetype column order once read
+        std::vector<ColumnImage> Columns;
+    };
+    // Grown as records are read, so header counts larger than the file fail at the first missing record
+    std::vector<ArchetypeImage> Images;
+    std::vector<const ComponentInfo*> Infos;
+    size_t TotalRows = 0;
+    // Entity indices placed by the archetypes, sparse values may only belong to them
+    std::vector<bool> Placed(Header.SlotCount);
+    for (uint32_t ArchIndex = 0; ArchIndex < Header.ArchetypeCount; ArchIndex++)
+    {
+        ArchetypeImage& Image = Images.emplace_back();
+        ArchetypeRecord Record;
+        Infos.clear();
+        if (!ReadRecord(In, Record) || Record.RowCount == 0
+            || !ReadColumnRecords(In, Record.ComponentCount, Image.Signature, Infos, &Image.Pairs))
+        {
+            return false;
+        }
+        Image.RowCount = static_cast<size_t>(Record.RowCount);
+        TotalRows += Image.RowCount;
+        for (auto Info : Infos)
+        {
+            Image.Columns.push_back({Info, nullptr, 0});
+        }
+        uint64_t Bytes;
+        Image.IDs = ReadBlock(In, Origin, Bytes);
+        if (Image.IDs == nullptr || Bytes != Image.RowCount * sizeof(EntityID))
+        {
+            return false;
+        }
+        for (size_t Row = 0; Row < Image.RowCount; Row++)
+        {
+            EntityID ID;
+            memcpy(&ID, Image.IDs + Row * sizeof(EntityID), sizeof(ID));
+            const uint32_t Index = GetEntityIndex(ID);
+            if (Index == 0 || Index >= Header.SlotCount)
+            {
+                return false;
+            }
+            uint32_t Generation;
+            memcpy(&Generation, Generations + static_cast<size_t>(Index) * sizeof(uint32_t), sizeof(Generation));
+            if (Generation != GetEntityGeneration(ID) || Placed[Index])
+            {
+                return false;
+            }
+            Placed[Index] = true;
+        }
+        for (auto& Stored : Image.Columns)
+        {
+            Stored.Data = ReadBlock(In, Origin, Stored.Bytes);
+            if (Stored.Data == nullptr
+                || (Stored.Info->TriviallyCopyable && Stored.Bytes != Image.RowCount * Stored.Info->Size))
+            {
+                return false;
+            }
+        }
+        std::sort(Image.Columns.begin(), Image.Columns.end(),
+            [](const ColumnImage& A, const ColumnImage& B) { return A.Info->ID < B.Info->ID; });
+    }
+    // Pairs may only point at entities of this snapshot
+    for (const auto& Image : Images)
+    {
+        for (const auto& [Relation, Target] : Image.Pairs)
+        {
+            const uint32_t Index = GetEntityIndex(Target);
+            if (Index >= Header.SlotCount || !Placed[Index])
+            {
+                return false;
+            }
+            uint32_t Generation;
+            memcpy(&Generation, Generations + static_cast<size_t>(Index) * sizeof(uint32_t), sizeof(Generation));
+            if (Generation != GetEntityGeneration(Target))
+            {
+                return false;
+            }
+        }
+    }
+
+    struct PoolImage
+    {
+        const ComponentInfo* Info;
+        size_t Count;
+        const uint8_t* IDs;
+        ColumnImage Values;
+    };
+    std::vector<PoolImage> Pools;
+    for (uint32_t PoolIndex = 0; PoolIndex < Header.SparseCount; PoolIndex++)
+    {
+        PoolImage& Pool = Pools.emplace_back();
+        ArchetypeRecord Record;
+        ArchSignature Signature;
+        Infos.clear();
+        if (!ReadRecord(In, Record) || Record.RowCount == 0 || Record.ComponentCount != 1
+            || !ReadColumnRecords(In, 1, Signature, Infos, nullptr, true) || Infos.empty())
+        {
+            return false;
+        }
+        Pool.Info = Infos[0];
+        Pool.Count = static_cast<size_t>(Record.RowCount);
+        uint64_t Bytes;
+        Pool.IDs = ReadBlock(In, Origin, Bytes);
+        if (Pool.IDs == nullptr || Bytes != Pool.Count * sizeof(EntityID))
+        {
+            return false;
+        }
+        std::vector<bool> Seen(Header.SlotCount);
+        for (size_t Row = 0; Row < Pool.Count; Row++)
+        {
+            EntityID ID;
+            memcpy(&ID, Pool.IDs + Row * sizeof(EntityID), sizeof(ID));
+            const uint32_t Index = GetEntityIndex(ID);
+            if (Index >= Header.SlotCount || !Placed[Index] || Seen[Index])
+            {
+                return false;
+            }
+            uint32_t Generation;
+            memcpy(&Generation, Generations + static_cast<size_t>(Index) * sizeof(uint32_t), sizeof(Generation));
+            if (Generation != GetEntityGeneration(ID))
+            {
+                return false;
+            }
+            Seen[Index] = true;
+        }
+        Pool.Values.Info = Pool.Info;
+        Pool.Values.Data = ReadBlock(In, Origin, Pool.Values.Bytes);
+        if (Pool.Values.Data == nullptr
+            || (Pool.Info->TriviallyCopyable && Pool.Values.Bytes != Pool.Count * Pool.Info->Size))
+        {
+            return false;
+        }
+    }
+    // Free slots are handed out again by AllocateEntity, so each must be a distinct slot no entity holds
+    std::vector<bool> Freed(Header.SlotCount);
+    for (uint32_t i = 0; i < Header.FreeCount; i++)
+    {
+        uint32_t Index;
+        memcpy(&Index, Free + static_cast<size_t>(i) * sizeof(uint32_t), sizeof(Index));
+        if (Index == 0 || Index >= Header.SlotCount || Placed[Index] || Freed[Index])
+        {
+            return false;
+        }
+        Freed[Index] = true;
+    }
+    ECS_TRACE_SCOPE("Load snapshot", TotalRows);
+
+    Slots.resize(Header.SlotCount);
+    for (uint32_t i = 0; i < Header.SlotCount; i++)
+    {
+        memcpy(&Slots[i].Generation, Generations + static_cast<size_t>(i) * sizeof(uint32_t), sizeof(uint32_t));
+    }
+    FreeSlots.resize(Header.FreeCount);
+    if (Header.FreeCount > 0)
+    {
+        memcpy(FreeSlots.data(), Free, Header.FreeCount * sizeof(uint32_t));
+    }
+    NextSlot = Header.SlotCount;
+
+    const ChangeTick Tick = GetWriteTick();
+    std::vector<EntityID> IDs;
+    std::vector<SnapshotReader> Readers;
+    for (const auto& Image : Images)
+    {
+        IDs.resize(Image.RowCount);
+        memcpy(IDs.data(), Image.IDs, Image.RowCount * sizeof(EntityID));
+        Readers.clear();
+        for (const auto& Stored : Image.Columns)
+        {
+            Readers.emplace_back(Stored.Data, Stored.Data + Stored.Bytes);
+        }
+        ArchSignature Signature = Image.Signature;
+        for (const auto& [Relation, Target] : Image.Pairs)
+        {
+            Signature.Add(GetPair(Relation, Target));
+        }
+        Archetype* Arch = FindOrAddArchetype(&Signature);
+        const size_t FirstRow = Arch->AddEntities(IDs.data(), Image.RowCount, Tick,
+            [&](Column& Store, size_t Index, size_t First, size_t Rows)
+            {
+                const ComponentInfo& Info = *Image.Columns[Index].Info;
+                if (!Info.TriviallyCopyable)
+                {
+                    for (size_t i = 0; i < Rows; i++)
+                    {
+                        Store.AddDefault(1);
+                        Info.Load(Readers[Index], Store.Get(Store.GetSize() - 1));
+                    }
+                    return;
+                }
+                const size_t RowBytes = Info.FieldCount > 0 ? Info.FieldSize : Info.Size;
+                Store.AddBytes(Image.Columns[Index].Data + First * RowBytes, Rows, Image.RowCount);
+            });
+        for (size_t Row = 0; Row < Image.RowCount; Row++)
+        {
+            EntitySlot& Slot = Slots[GetEntityIndex(IDs[Row])];
+            Slot.Arch = Arch;
+            Slot.Row = FirstRow + Row;
+            Slot.PlacedTick = Tick;
+        }
+    }
+    for (const auto& Image : Pools)
+    {
+        SparseSet* Pool = GetSparsePool(Image.Info->ID);
+        SnapshotReader Values(Image.Values.Data, Image.Values.Data + Image.Values.Bytes);
+        for (size_t Row = 0; Row < Image.Count; Row++)
+        {
+            EntityID ID;
+            memcpy(&ID, Image.IDs + Row * sizeof(EntityID), sizeof(ID));
+            if (Image.Info->TriviallyCopyable)
+            {
+                Pool->Set(ID, Image.Values.Data + Row * Image.Info->Size);
+            }
+            else
+            {
+                Image.Info->Load(Values, Pool->Add(ID));
+            }
+        }
+    }
+    return true;
+}
+
+struct DeltaHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    ChangeTick Since;
+    ChangeTick Until;
+    uint32_t DeletedCount;
+    uint32_t SectionCount;
+};
+
+// One per archetype with something to send, followed by its ColumnRecords and then its row groups
+struct DeltaSection
+{
+    uint32_t ComponentCount;
+    uint32_t GroupCount;
+};
+
+// Rows of one section sending the same columns. Followed by the indices of those columns, the entity IDs and then,
+// column after column, one value per row. Hooked values are prefixed with their byte count so they can be skipped
+struct DeltaGroup
+{
+    // The entities entered the archetype and every column is sent
+    uint32_t Placed;
+    uint32_t RowCount;
+    uint32_t ColumnCount;
+    uint32_t Reserved;
+};
+
+struct DeltaRow
+{
+    const ArchetypeChunk* Chunk;
+    size_t Row;
+};
+
+static void WriteDeltaValue(SnapshotWriter& Out, Column& Store, size_t Row)
+{
+    const ComponentInfo& Info = Store.GetInfo();
+    if (!Info.TriviallyCopyable)
+    {
+        const size_t CountAt = Out.GetOffset();
+        Out.Write<uint32_t>(0);
+        Info.Save(Out, Store.Get(Row));
+        const uint32_t Bytes = static_cast<uint32_t>(Out.GetOffset() - CountAt - sizeof(uint32_t));
+        Out.Patch(CountAt, &Bytes, sizeof(Bytes));
+    }
+    else if (Store.IsSplit())
+    {
+        // Gathered back into a whole value
+        for (size_t Field = 0; Field < Info.FieldCount; Field++)
+        {
+            Out.WriteBytes(static_cast<const uint8_t*>(Store.GetField(Field)) + Row * Info.FieldSize, Info.FieldSize);
+        }
+    }
+    else
+    {
+        Out.WriteBytes(Store.Get(Row), Info.Size);
+    }
+}
+
+static void WriteDeltaGroup(SnapshotWriter& Out, bool Placed, const std::vector<DeltaRow>& Rows,
+    const std::vector<uint32_t>& Columns)
+{
+    Out.Write(DeltaGroup{Placed ? 1u : 0u, static_cast<uint32_t>(Rows.size()), static_cast<uint32_t>(Columns.size()), 0});
+    Out.WriteBytes(Columns.data(), Columns.size() * sizeof(uint32_t));
+    for (const auto& Ref : Rows)
+    {
+        Out.Write(Ref.Chunk->GetEntityIDs()[Ref.Row]);
+    }
+    for (uint32_t Index : Columns)
+    {
+        for (const auto& Ref : Rows)
+        {
+            WriteDeltaValue(Out, *Ref.Chunk->GetColumn(Index), Ref.Row);
+        }
+    }
+}
+
+ChangeTick World::WriteDelta(ChangeTick Since, std::vector<uint8_t>& Out) const
+{
+    if (WorldLock)
+    {
+        Error("Cannot write a delta while world is locked\n");
+    }
+    ECS_TRACE_SCOPE("Write delta", Since);
+    const ChangeTick Until = CurrentTick;
+    SnapshotWriter Writer(Out);
+    DeltaHeader Header{DeltaMagic, DeltaVersion, Since, Until, 0, 0};
+    Writer.Write(Header);
+    // The log is in tick order
+    auto FirstDeleted = std::partition_point(DeletedLog.begin(), DeletedLog.end(),
+        [&](const auto& Entry) { return Entry.second <= Since; });
+    for (auto Entry = FirstDeleted; Entry != DeletedLog.end(); ++Entry)
+    {
+        Writer.Write(Entry->first);
+        Header.DeletedCount++;
+    }
+
+    std::vector<DeltaRow> Rows;
+    std::vector<uint32_t> Columns;
+    for (auto Arch : Archetypes)
+    {
+        // Entities that left an archetype are sent with the one they entered
+        if (Arch->GetEntityCount() == 0)
+        {
+            continue;
+        }
+        const size_t ColumnCount = Arch->GetChunk(0)->GetColumnCount();
+        bool Touched = false;
+        for (size_t c = 0; c < Arch->GetChunkCount() && !Touched; c++)
+        {
+            const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+            Touched = Chunk->GetCount() > 0 && Chunk->GetPlacedTick() > Since;
+            for (size_t Index = 0; Index < ColumnCount && !Touched; Index++)
+            {
+                Touched = Chunk->GetCount() > 0 && Chunk->GetChangedTick(Index) > Since;
+            }
+        }
+        if (!Touched)
+        {
+            continue;
+        }
+        CheckSnapshotHooks(*Arch);
+
+        const size_t SectionAt = Writer.GetOffset();
+        DeltaSection Section{static_cast<uint32_t>(Arch->GetSignature()->Count()), 0};
+        Writer.Write(Section);
+        WriteColumnRecords(Writer, *Arch);
+
+        // Entities that entered the archetype are sent whole, every other row only for the columns written
+        auto IsPlaced = [&](const ArchetypeChunk* Chunk, size_t Row)
+        {
+            return Slots[GetEntityIndex(Chunk->GetEntityIDs()[Row])].PlacedTick > Since;
+        };
+        Rows.clear();
+        for (size_t c = 0; c < Arch->GetChunkCount(); c++)
+        {
+            const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+            for (size_t Row = 0; Chunk->GetPlacedTick() > Since && Row < Chunk->GetCount(); Row++)
+            {
+                if (IsPlaced(Chunk, Row))
+                {
+                    Rows.push_back({Chunk, Row});
+                }
+            }
+        }
+        if (!Rows.empty())
+        {
+            Columns.resize(ColumnCount);
+            for (size_t Index = 0; Index < ColumnCount; Index++)
+            {
+                Columns[Index] = static_cast<uint32_t>(Index);
+            }
+            WriteDeltaGroup(Writer, true, Rows, Columns);
+            Section.GroupCount++;
+        }
+        for (size_t c = 0; c < Arch->GetChunkCount(); c++)
+        {
+            const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+            Columns.clear();
+            for (size_t Index = 0; Index < ColumnCount; Index++)
+            {
+                if (Chunk->GetChangedTick(Index) > Since)
+                {
+                    Columns.push_back(static_cast<uint32_t>(Index));
+                }
+            }
+            Rows.clear();
+            for (size_t Row = 0; !Columns.empty() && Row < Chunk->GetCount(); Row++)
+            {
+                if (!IsPlaced(Chunk, Row))
+                {
+                    Rows.push_back({Chunk, Row});
+                }
+            }
+            if (!Rows.empty())
+            {
+                WriteDeltaGroup(Writer, false, Rows, Columns);
+                Section.GroupCount++;
+            }
+        }
+        Writer.Patch(SectionAt, &Section, sizeof(Section));
+        Header.SectionCount++;
+    }
+    Writer.Patch(0, &Header, sizeof(Header));
+    return Until;
+}
+
+bool World::ApplyDelta(const uint8_t* Data, size_t Bytes)
+{
+    if (WorldLock)
+    {
+        Error("Cannot apply a delta while world is locked\n");
+    }
+    ECS_TRACE_SCOPE("Apply delta", Bytes);
+    SnapshotReader In(Data, Data + Bytes);
+    DeltaHeader Header;
+    if (!ReadRecord(In, Header) || Header.Magic != DeltaMagic || Header.Version != DeltaVersion)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < Header.DeletedCount; i++)
+    {
+        EntityID Entity;
+        if (!ReadRecord(In, Entity))
+        {
+            return false;
+        }
+        Delete(Entity);
+    }
+
+    const ChangeTick Tick = GetWriteTick();
+    std::vector<const ComponentInfo*> Infos;
+    std::vector<uint32_t> Columns;
+    std::vector<EntityID> IDs;
+    std::vector<std::pair<ComponentID, EntityID>> Pairs;
+    for (uint32_t s = 0; s < Header.SectionCount; s++)
+    {
+        DeltaSection Section;
+        ArchSignature Signature;
+        Infos.clear();
+        Pairs.clear();
+        if (!ReadRecord(In, Section) || !ReadColumnRecords(In, Section.ComponentCount, Signature, Infos, &Pairs))
+        {
+            return false;
+        }
+        for (const auto& [Relation, Target] : Pairs)
+        {
+            Signature.Add(GetPair(Relation, Target));
+        }
+        Archetype* Arch = FindOrAddArchetype(&Signature);
+        for (uint32_t g = 0; g < Section.GroupCount; g++)
+        {
+            DeltaGroup Group;
+            if (!ReadRecord(In, Group))
+            {
+                return false;
+            }
+            const uint8_t* ColumnData = In.Take(static_cast<size_t>(Group.ColumnCount) * sizeof(uint32_t));
+            const uint8_t* IDData = In.Take(static_cast<size_t>(Group.RowCount) * sizeof(EntityID));
+            if (ColumnData == nullptr || IDData == nullptr || Group.RowCount == 0)
+            {
+                return false;
+            }
+            Columns.resize(Group.ColumnCount);
+            IDs.resize(Group.RowCount);
+            if (!Columns.empty())
+            {
+                memcpy(Columns.data(), ColumnData, Columns.size() * sizeof(uint32_t));
+            }
+            memcpy(IDs.data(), IDData, IDs.size() * sizeof(EntityID));
+            for (size_t i = 0; i < IDs.size(); i++)
+            {
+                if (GetEntityIndex(IDs[i]) == 0)
+                {
+                    return false;
+                }
+                if (Group.Placed != 0)
+                {
+                    PlaceEntity(IDs[i], Arch);
+                }
+            }
+
+            for (uint32_t Index : Columns)
+            {
+                if (Index >= Infos.size())
+                {
+                    return false;
+                }
+                const ComponentInfo& Info = *Infos[Index];
+                for (EntityID Entity : IDs)
+                {
+                    uint32_t ValueBytes = static_cast<uint32_t>(Info.Size);
+                    if (!Info.TriviallyCopyable && !ReadRecord(In, ValueBytes))
+                    {
+                        return false;
+                    }
+                    const uint8_t* Value = In.Take(ValueBytes);
+                    if (Value == nullptr)
+                    {
+                        return false;
+                    }
+                    // Rows of entities this world does not have in that shape are skipped
+                    const EntitySlot* Slot = FindSlot(Entity);
+                    if (Slot == nullptr || !Slot->Arch->GetSignature()->Contains(Info.ID))
+                    {
+                        continue;
+                    }
+                    if (Info.TriviallyCopyable)
+                    {
+                        Slot->Arch->SetValue(Slot->Row, Info.ID, Value, Tick);
+                        continue;
+                    }
+                    SnapshotReader ValueIn(Value, Value + ValueBytes);
+                    Info.Load(ValueIn, Slot->Arch->GetValue(Slot->Row, Info.ID));
+                    Slot->Arch->MarkChanged(Slot->Row, Info.ID, Tick);
+                }
+            }
+        }
+    }
+    return true;
+}
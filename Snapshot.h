@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <vector>
+
+#include "Component.h"
+
+// Snapshot files written by World::SaveSnapshot. Components are matched by the hash of their ComponentName, so
+// any build naming them the same can load a snapshot whatever order it registers them in. Data is in native byte
+// order and raw rows are copied as is, so the loading build needs the same byte order and component layouts
+constexpr uint32_t SnapshotMagic = 0x53434553;
+constexpr uint32_t SnapshotVersion = 5;
+// Deltas from World::WriteDelta follow the same rules
+constexpr uint32_t DeltaMagic = 0x44434553;
+constexpr uint32_t DeltaVersion = 4;
+
+// Byte sink handed to component save hooks, either a file or the end of a buffer
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(FILE* File);
+    explicit SnapshotWriter(std::vector<uint8_t>& Buffer);
+
+    void WriteBytes(const void* Data, size_t Bytes);
+
+    template<typename T>
+    void Write(const T& Value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written directly");
+        WriteBytes(&Value, sizeof(T));
+    }
+
+    // Zero fills up to the next multiple of Alignment, counted from where writing started
+    void Pad(size_t Alignment);
+    size_t GetOffset() const { return Offset; }
+    // Overwrites bytes written earlier without moving the end of the file
+    void Patch(size_t At, const void* Data, size_t Bytes);
+    bool HasFailed() const { return Failed; }
+
+private:
+    FILE* File = nullptr;
+    std::vector<uint8_t>* Buffer = nullptr;
+    // Where writing started in Buffer
+    size_t Base = 0;
+    size_t Offset = 0;
+    bool Failed = false;
+};
+
+// Read side of SnapshotWriter, over a mapped snapshot. Reading past what a save hook wrote is a fatal error
+class SnapshotReader
+{
+public:
+    SnapshotReader(const uint8_t* Begin, const uint8_t* End);
+
+    void ReadBytes(void* Out, size_t Bytes);
+
+    template<typename T>
+    T Read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read directly");
+        T Value;
+        ReadBytes(&Value, sizeof(T));
+        return Value;
+    }
+
+    // Hands out the next Bytes in place, null when fewer are left
+    const uint8_t* Take(size_t Bytes);
+    // Skips up to the next multiple of Alignment, counted from Origin
+    bool Align(const uint8_t* Origin, size_t Alignment);
+    size_t GetRemaining() const { return static_cast<size_t>(End - Cursor); }
+
+private:
+    const uint8_t* Cursor;
+    const uint8_t* End;
+};
+
+// Registers how a component that is not trivially copyable goes in and out of snapshots
+template<typename T, void (*Save)(SnapshotWriter&, const T&), void (*Load)(SnapshotReader&, T&)>
+void SetSnapshotHooks()
+{
+    SetSnapshotHooks(GetComponent<T>(),
+        [](SnapshotWriter& Out, const void* Value) { Save(Out, *static_cast<const T*>(Value)); },
+        [](SnapshotReader& In, void* Value) { Load(In, *static_cast<T*>(Value)); });
+}
@@ -0,0 +1,98 @@
+﻿#include "SparseSet.h"
+
+SparseSet::SparseSet(const ComponentInfo& Info, std::pmr::memory_resource* Resource):
+    Sparse(Resource),
+    Dense(Resource),
+    Values(Info, Resource)
+{
+}
+
+uint32_t SparseSet::FindRow(EntityID Entity) const
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Sparse.size() || Sparse[Index] == NoRow || Dense[Sparse[Index]] != Entity)
+    {
+        return NoRow;
+    }
+    return Sparse[Index];
+}
+
+void* SparseSet::Get(EntityID Entity)
+{
+    const uint32_t Row = FindRow(Entity);
+    return Row == NoRow ? nullptr : Values.Get(Row);
+}
+
+bool SparseSet::Contains(EntityID Entity) const
+{
+    return FindRow(Entity) != NoRow;
+}
+
+void SparseSet::Set(EntityID Entity, const void* Data)
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Sparse.size())
+    {
+        Sparse.resize(Index + 1, NoRow);
+    }
+    const uint32_t Row = Sparse[Index];
+    if (Row != NoRow)
+    {
+        Dense[Row] = Entity;
+        Values.Set(Row, Data);
+        return;
+    }
+    Sparse[Index] = static_cast<uint32_t>(Dense.size());
+    Dense.push_back(Entity);
+    Values.AddCopy(Data);
+}
+
+void* SparseSet::Add(EntityID Entity)
+{
+    const uint32_t Row = FindRow(Entity);
+    if (Row != NoRow)
+    {
+        return Values.Get(Row);
+    }
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Sparse.size())
+    {
+        Sparse.resize(Index + 1, NoRow);
+    }
+    Sparse[Index] = static_cast<uint32_t>(Dense.size());
+    Dense.push_back(Entity);
+    Values.AddDefault(1);
+    return Values.Get(Values.GetSize() - 1);
+}
+
+size_t SparseSet::ShrinkToFit()
+{
+    // Entity indices past the last one having a value map to nothing
+    while (!Sparse.empty() && Sparse.back() == NoRow)
+    {
+        Sparse.pop_back();
+    }
+    const size_t Before = Sparse.capacity() * sizeof(uint32_t) + Dense.capacity() * sizeof(EntityID);
+    Sparse.shrink_to_fit();
+    Dense.shrink_to_fit();
+    return Values.ShrinkToFit() + Before - Sparse.capacity() * sizeof(uint32_t) - Dense.capacity() * sizeof(EntityID);
+}
+
+void SparseSet::Remove(EntityID Entity)
+{
+    const uint32_t Row = FindRow(Entity);
+    if (Row == NoRow)
+    {
+        return;
+    }
+    const uint32_t Last = static_cast<uint32_t>(Dense.size() - 1);
+    if (Row != Last)
+    {
+        Values.ReplaceWithMoved(Row, Values, Last);
+        Dense[Row] = Dense[Last];
+        Sparse[GetEntityIndex(Dense[Row])] = Row;
+    }
+    Values.PopBack();
+    Dense.pop_back();
+    Sparse[GetEntityIndex(Entity)] = NoRow;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "Column.h"
+#include "Types.h"
+
+// Values of one sparse component, see ComponentStorage. Values sit packed in a dense column, the last one filling
+// any hole, and a sparse array maps entity indices to their row, so lookup, insertion and removal are all O(1)
+// and never touch the entity's archetype row
+class SparseSet
+{
+public:
+    SparseSet(const ComponentInfo& Info, std::pmr::memory_resource* Resource);
+    SparseSet(const SparseSet& obj) = delete;
+
+    // Null when Entity has no value here
+    void* Get(EntityID Entity);
+    bool Contains(EntityID Entity) const;
+    // Copies Data in, over the current value if there is one
+    void Set(EntityID Entity, const void* Data);
+    // The current value, or a default constructed one added for Entity
+    void* Add(EntityID Entity);
+    void Remove(EntityID Entity);
+    // Trims storage kept from a past peak, returns the bytes freed
+    size_t ShrinkToFit();
+
+    size_t GetCount() const { return Dense.size(); }
+    const EntityID* GetEntityIDs() const { return Dense.data(); }
+    Column& GetValues() { return Values; }
+    const Column& GetValues() const { return Values; }
+
+private:
+    static constexpr uint32_t NoRow = UINT32_MAX;
+    uint32_t FindRow(EntityID Entity) const;
+
+    // Indexed by entity index
+    std::pmr::vector<uint32_t> Sparse;
+    std::pmr::vector<EntityID> Dense;
+    Column Values;
+};
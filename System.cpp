@@ -1,36 +1,169 @@
 ﻿#include "System.h"
 
+#include "ErrorHandling.h"
+
 System::System(const ArchSignature& signature, const std::function<void(World*, Entity&)>& handler):
     Signature(signature),
     Handler(handler)
 {
 }
 
-ArchSignature System::GetSignature() const
+System::System(const ArchSignature& signature, const std::function<void(World*, Archetype*)>& archetypeHandler):
+    Signature(signature),
+    ArchetypeHandler(archetypeHandler)
+{
+}
+
+System::System(const ArchSignature& signature, const ArchSignature& reads, const ArchSignature& writes,
+    const RowRangeHandler& rangeHandler):
+    Signature(signature),
+    RangeHandler(rangeHandler),
+    Reads(reads),
+    Writes(writes),
+    Exclusive(false)
+{
+}
+
+const ArchSignature& System::GetSignature() const
 {
     return Signature;
 }
 
-std::function<void(World*, Entity&)> System::GetHandler() const
+const std::function<void(World*, Entity&)>& System::GetHandler() const
 {
     return Handler;
 }
 
-void System::TryAddMatch(Archetype* Arch)
+const std::function<void(World*, Archetype*)>& System::GetArchetypeHandler() const
+{
+    return ArchetypeHandler;
+}
+
+bool System::IsArchetypeSystem() const
+{
+    return static_cast<bool>(ArchetypeHandler);
+}
+
+const System::RowRangeHandler& System::GetRangeHandler() const
+{
+    return RangeHandler;
+}
+
+bool System::IsRangeSystem() const
+{
+    return static_cast<bool>(RangeHandler);
+}
+
+void System::SetParallel(const ParallelSettings& Settings)
+{
+    if (!IsRangeSystem())
+    {
+        Error("Only row range systems can run in parallel\n");
+    }
+    if (Settings.ChunkSize == 0)
+    {
+        Error("Parallel chunk size must be positive\n");
+    }
+    Parallel = Settings;
+    RunParallel = true;
+}
+
+const ParallelSettings& System::GetParallelSettings() const
+{
+    return Parallel;
+}
+
+bool System::IsParallel() const
+{
+    return RunParallel;
+}
+
+void System::SetExclusions(const ArchSignature& Without)
+{
+    Excluded = Without;
+}
+
+const ArchSignature& System::GetExclusions() const
 {
-    const ArchSignature& ArchSig = *Arch->GetSignature();
-    for (auto CmpID : Signature)
+    return Excluded;
+}
+
+void System::SetChangeFilters(const ArchSignature& Changed, const ArchSignature& Added)
+{
+    if (!IsRangeSystem())
+    {
+        Error("Only row range systems can filter on changes\n");
+    }
+    ChangedFilter = Changed;
+    AddedFilter = Added;
+    Filtered = !Changed.IsEmpty() || !Added.IsEmpty();
+}
+
+bool System::PassesChangeFilters(const Archetype& Arch, const ArchetypeChunk& Chunk) const
+{
+    if (!Filtered)
+    {
+        return true;
+    }
+    for (const auto Type : ChangedFilter)
     {
-        const auto Found = ArchSig.find(CmpID);
-        if (Found == ArchSig.end())
+        if (Chunk.GetChangedTick(Arch.GetColumnIndex(Type)) <= LastRunTick)
         {
-            return;
+            return false;
         }
     }
-    MatchedArchetypes.emplace_back(Arch);
+    for (const auto Type : AddedFilter)
+    {
+        if (Chunk.GetAddedTick(Arch.GetColumnIndex(Type)) <= LastRunTick)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+ChangeTick System::GetLastRunTick() const
+{
+    return LastRunTick;
+}
+
+void System::SetLastRunTick(ChangeTick Tick)
+{
+    LastRunTick = Tick;
+}
+
+const ArchSignature& System::GetReads() const
+{
+    return Reads;
+}
+
+const ArchSignature& System::GetWrites() const
+{
+    return Writes;
+}
+
+bool System::IsExclusive() const
+{
+    return Exclusive;
+}
+
+bool System::ConflictsWith(const System& Other) const
+{
+    if (Exclusive || Other.Exclusive)
+    {
+        return true;
+    }
+    return Writes.Intersects(Other.Writes)
+        || Writes.Intersects(Other.Reads)
+        || Reads.Intersects(Other.Writes);
+}
+
+void System::SetQuery(const Query* query)
+{
+    Matches = query;
 }
 
-std::vector<Archetype*>* System::GetMatchedArchetypes()
+const std::vector<Archetype*>* System::GetMatchedArchetypes() const
 {
-    return &MatchedArchetypes;
+    return &Matches->GetMatchedArchetypes();
 }
@@ -2,21 +2,79 @@
 #include <functional>
 
 #include "Archetype.h"
+#include "Query.h"
 
 class Entity;
 
+struct ParallelSettings
+{
+    // Rows handed to a single job. Each chunk records structural changes into its own queue and the queues are
+    // merged in chunk order, so the outcome does not depend on which thread ran which chunk
+    size_t ChunkSize = 1024;
+    // Upper bound on threads working on one pass, 0 uses the whole pool
+    unsigned ThreadCount = 0;
+};
+
 class System
 {
 public:
+    typedef std::function<void(class World*, Archetype*, size_t Begin, size_t End)> RowRangeHandler;
+
     System(const ArchSignature& signature, const std::function<void(class World*, Entity&)>& handler);
+    // Handler is invoked once per matched archetype and is expected to walk the columns itself
+    System(const ArchSignature& signature, const std::function<void(class World*, Archetype*)>& archetypeHandler);
+    // Same as above but declares which components the handler reads and writes so the scheduler can run it
+    // alongside other systems. Systems without declared access are exclusive and always run on their own
+    // Handler gets a row range of a matched archetype, which lets the system be split into parallel chunks
+    System(const ArchSignature& signature, const ArchSignature& reads, const ArchSignature& writes,
+        const RowRangeHandler& rangeHandler);
+
+    const ArchSignature& GetSignature() const;
+    const std::function<void(World*, Entity&)>& GetHandler() const;
+    const std::function<void(World*, Archetype*)>& GetArchetypeHandler() const;
+    bool IsArchetypeSystem() const;
+    const RowRangeHandler& GetRangeHandler() const;
+    bool IsRangeSystem() const;
+
+    // Splits the rows of all matched archetypes into chunks run across the worker pool. Only for range systems
+    void SetParallel(const ParallelSettings& Settings);
+    const ParallelSettings& GetParallelSettings() const;
+    bool IsParallel() const;
+
+    // Archetypes having any component of Without are never matched
+    void SetExclusions(const ArchSignature& Without);
+    const ArchSignature& GetExclusions() const;
+
+    // Chunks are only visited when every component in Changed was written, and every component in Added was
+    // added, after the previous run of this system
+    void SetChangeFilters(const ArchSignature& Changed, const ArchSignature& Added);
+    bool PassesChangeFilters(const Archetype& Arch, const ArchetypeChunk& Chunk) const;
+    ChangeTick GetLastRunTick() const;
+    void SetLastRunTick(ChangeTick Tick);
+
+    const ArchSignature& GetReads() const;
+    const ArchSignature& GetWrites() const;
+    bool IsExclusive() const;
+    bool ConflictsWith(const System& Other) const;
 
-    ArchSignature GetSignature() const;
-    std::function<void(World*, Entity&)> GetHandler() const;
-    void TryAddMatch(Archetype* Arch);
-    std::vector<Archetype*>* GetMatchedArchetypes();
+    // Set by the world when the system is added, the query belongs to the world
+    void SetQuery(const Query* query);
+    const std::vector<Archetype*>* GetMatchedArchetypes() const;
 
 private:
     const ArchSignature Signature;
     std::function<void(World*, Entity&)> Handler;
-    std::vector<Archetype*> MatchedArchetypes;
+    std::function<void(World*, Archetype*)> ArchetypeHandler;
+    RowRangeHandler RangeHandler;
+    ParallelSettings Parallel;
+    bool RunParallel = false;
+    ArchSignature Reads;
+    ArchSignature Writes;
+    bool Exclusive = true;
+    ArchSignature Excluded;
+    ArchSignature ChangedFilter;
+    ArchSignature AddedFilter;
+    bool Filtered = false;
+    ChangeTick LastRunTick = 0;
+    const Query* Matches = nullptr;
 };
@@ -0,0 +1,135 @@
+﻿#include <vector>
+
+#include "ChangeFilters.h"
+#include "Entity.h"
+#include "TestHarness.h"
+#include "TestComponents.h"
+#include "World.h"
+
+static const size_t ChunkSizes[] = {0, 1024};
+
+// How often a Changed<Position> and an Added<Position> system visited Watched. Both only read Position, a writing
+// system would stamp every chunk it visits and make the other see changes everywhere
+struct ChangeCounts
+{
+    EntityID Watched = 0;
+    size_t Changed = 0;
+    size_t Added = 0;
+};
+
+static void AddCountingSystems(World& Wld, ChangeCounts& Counts)
+{
+    Wld.AddSystem<Changed<const Position>>([&Counts](World*, EntityID Entity, const Position&)
+    {
+        Counts.Changed += Entity == Counts.Watched ? 1 : 0;
+    });
+    Wld.AddSystem<Added<const Position>>([&Counts](World*, EntityID Entity, const Position&)
+    {
+        Counts.Added += Entity == Counts.Watched ? 1 : 0;
+    });
+}
+
+ECS_TEST(ChangedSeenAfterSwapIntoOlderChunk)
+{
+    WorldConfig Config;
+    Config.ChunkBytes = 1024;
+    World Wld(Config);
+    std::vector<EntityID> IDs;
+    Wld.Spawn<Position>(1000, [&](World*, EntityID Entity, Position&) { IDs.push_back(Entity); });
+    ChangeCounts Counts;
+    AddCountingSystems(Wld, Counts);
+    Wld.Tick();
+
+    // The last row fills the hole the delete leaves in the first chunk
+    Counts.Watched = IDs.back();
+    Wld.Set(IDs.back(), Position{1, 1});
+    Wld.Delete(IDs.front());
+    Wld.Tick();
+    ECS_CHECK(Counts.Changed == 1);
+    Wld.Tick();
+    ECS_CHECK(Counts.Changed == 1);
+}
+
+ECS_TEST(AddedSeenAfterSwapIntoOlderChunk)
+{
+    WorldConfig Config;
+    Config.ChunkBytes = 1024;
+    World Wld(Config);
+    std::vector<EntityID> IDs;
+    Wld.Spawn<Position>(1000, [&](World*, EntityID Entity, Position&) { IDs.push_back(Entity); });
+    ChangeCounts Counts;
+    AddCountingSystems(Wld, Counts);
+    Wld.Tick();
+
+    Counts.Watched = Wld.NewEntity().GetID();
+    Wld.Set(Counts.Watched, Position{1, 1});
+    Wld.Delete(IDs.front());
+    Wld.Tick();
+    ECS_CHECK(Counts.Added == 1);
+}
+
+ECS_TEST(ChangedSeenAfterMoveToOtherArchetype)
+{
+    for (size_t ChunkBytes : ChunkSizes)
+    {
+        WorldConfig Config;
+        Config.ChunkBytes = ChunkBytes;
+        World Wld(Config);
+        // The destination archetype already exists and has not changed since the systems last ran
+        const EntityID Resident = Wld.NewEntity().GetID();
+        Wld.Set(Resident, Position{0, 0});
+        Wld.Set(Resident, Velocity{0, 0});
+        ChangeCounts Counts;
+        AddCountingSystems(Wld, Counts);
+        Counts.Watched = Wld.NewEntity().GetID();
+        Wld.Set(Counts.Watched, Position{0, 0});
+        Wld.Tick();
+        ECS_CHECK(Counts.Changed == 1 && Counts.Added == 1);
+
+        Wld.Set(Counts.Watched, Position{2, 2});
+        Wld.Set(Counts.Watched, Velocity{1, 1});
+        Wld.Tick();
+        ECS_CHECK(Counts.Changed == 2);
+        ECS_CHECK(Counts.Added == 1);
+    }
+}
+
+ECS_TEST(AddedSeenAfterMoveToOtherArchetype)
+{
+    for (size_t ChunkBytes : ChunkSizes)
+    {
+        WorldConfig Config;
+        Config.ChunkBytes = ChunkBytes;
+        World Wld(Config);
+        const EntityID Resident = Wld.NewEntity().GetID();
+        Wld.Set(Resident, Position{0, 0});
+        Wld.Set(Resident, Velocity{0, 0});
+        ChangeCounts Counts;
+        AddCountingSystems(Wld, Counts);
+        Wld.Tick();
+
+        Counts.Watched = Wld.NewEntity().GetID();
+        Wld.Set(Counts.Watched, Position{0, 0});
+        Wld.Set(Counts.Watched, Velocity{1, 1});
+        Wld.Tick();
+        ECS_CHECK(Counts.Added == 1);
+        ECS_CHECK(Counts.Changed == 1);
+    }
+}
+
+// Writes made through a system's own columns are seen by a later system of the same tick and not again after
+ECS_TEST(SystemWritesSeenEachTick)
+{
+    World Wld;
+    const EntityID Entity = Wld.NewEntity().GetID();
+    Wld.Set(Entity, Position{0, 0});
+    Wld.Set(Entity, Velocity{1, 0});
+    Wld.AddSystem<Position, const Velocity>([](Position& Pos, const Velocity& Vel) { Pos.X += Vel.X; });
+    ChangeCounts Counts;
+    Counts.Watched = Entity;
+    AddCountingSystems(Wld, Counts);
+    Wld.Tick();
+    Wld.Tick();
+    ECS_CHECK(Counts.Changed == 2);
+    ECS_CHECK(Counts.Added == 1);
+}
@@ -0,0 +1,26 @@
+﻿#include "Component.h"
+#include "Entity.h"
+#include "TestHarness.h"
+#include "TestComponents.h"
+#include "World.h"
+
+ECS_TEST(ConstComponentIsThePlainOne)
+{
+    ECS_CHECK(GetComponent<const Position>() == GetComponent<Position>());
+    ECS_CHECK(ComponentTypeHash<const Position> == ComponentTypeHash<Position>);
+
+    World Wld;
+    const EntityID Entity = Wld.NewEntity().GetID();
+    Wld.Set(Entity, Position{1, 2});
+    const Position* Read = Wld.Get<const Position>(Entity);
+    ECS_CHECK(Read != nullptr && Read == Wld.Get<Position>(Entity));
+    ECS_CHECK(Read != nullptr && Read->X == 1 && Read->Y == 2);
+}
+
+ECS_TEST(ComponentsFoundByNameHash)
+{
+    const ComponentID Type = GetComponent<Health>();
+    ECS_CHECK(FindComponent(ComponentTypeHash<Health>) == Type);
+    ECS_CHECK(GetComponentInfo(Type).Name == ComponentName<Health>::Value);
+    ECS_CHECK(FindComponent(HashComponentName("NeverRegistered")) == InvalidComponentID);
+}
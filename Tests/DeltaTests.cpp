@@ -0,0 +1,154 @@
+﻿#include <map>
+#include <tuple>
+#include <vector>
+
+#include "Entity.h"
+#include "TestHarness.h"
+#include "TestComponents.h"
+#include "World.h"
+
+static const size_t ChunkSizes[] = {0, 1024};
+
+static WorldConfig TrackingConfig(size_t ChunkBytes)
+{
+    WorldConfig Config;
+    Config.ChunkBytes = ChunkBytes;
+    Config.TrackDeltas = true;
+    return Config;
+}
+
+// Sends what changed in Source since Since to Mirror and returns the tick to send from next time
+static ChangeTick Replicate(const World& Source, World& Mirror, ChangeTick Since)
+{
+    std::vector<uint8_t> Delta;
+    const ChangeTick Until = Source.WriteDelta(Since, Delta);
+    ECS_CHECK(Mirror.ApplyDelta(Delta.data(), Delta.size()));
+    return Until;
+}
+
+// Health and velocity of every entity having Health, read through const terms. World::Get would count as a write
+// and get the whole chunk sent with the next delta, hiding rows a delta misses
+typedef std::map<EntityID, std::tuple<int, bool, float, float>> WorldValues;
+
+static WorldValues ReadValues(World& Wld)
+{
+    WorldValues Values;
+    Query* WithHealth = Wld.AddQuery<Health>();
+    Wld.ForEach<const Health>(*WithHealth, [&](World*, EntityID Entity, const Health& Value)
+    {
+        Values[Entity] = {Value.Value, false, 0.0f, 0.0f};
+    });
+    Wld.RemoveQuery(WithHealth);
+    Query* WithVelocity = Wld.AddQuery<Health, Velocity>();
+    Wld.ForEach<const Velocity>(*WithVelocity, [&](World*, EntityID Entity, const Velocity& Value)
+    {
+        auto& Entry = Values[Entity];
+        Entry = {std::get<0>(Entry), true, Value.X, Value.Y};
+    });
+    Wld.RemoveQuery(WithVelocity);
+    return Values;
+}
+
+static bool Mirrors(World& Source, World& Mirror)
+{
+    return ReadValues(Source) == ReadValues(Mirror);
+}
+
+static int HealthOf(World& Wld, EntityID Entity)
+{
+    const WorldValues Values = ReadValues(Wld);
+    const auto Found = Values.find(Entity);
+    return Found != Values.end() ? std::get<0>(Found->second) : -1;
+}
+
+// A write in the last chunk followed by a delete in the first swaps the written row into a chunk that was not
+// otherwise touched, the write must still be sent
+ECS_TEST(DeltaSendsWriteSwappedIntoOlderChunk)
+{
+    World Source(TrackingConfig(1024));
+    World Mirror;
+    std::vector<EntityID> IDs;
+    Source.Spawn<Health>(1000, [&](World*, EntityID Entity, Health& Value)
+    {
+        Value.Value = static_cast<int>(IDs.size());
+        IDs.push_back(Entity);
+    });
+    ChangeTick Since = Replicate(Source, Mirror, 0);
+    ECS_CHECK(Mirrors(Source, Mirror));
+
+    Source.Set(IDs.back(), Health{42});
+    Source.Delete(IDs.front());
+    Since = Replicate(Source, Mirror, Since);
+    ECS_CHECK(HealthOf(Mirror, IDs.back()) == 42);
+    ECS_CHECK(!Mirror.IsAlive(IDs.front()));
+    ECS_CHECK(Mirrors(Source, Mirror));
+}
+
+// A write followed by a move into an archetype whose chunk is older, the entity goes whole with its new archetype
+ECS_TEST(DeltaSendsWriteBeforeArchetypeMove)
+{
+    for (size_t ChunkBytes : ChunkSizes)
+    {
+        World Source(TrackingConfig(ChunkBytes));
+        World Mirror;
+        const EntityID Resident = Source.NewEntity().GetID();
+        Source.Set(Resident, Health{1});
+        Source.Set(Resident, Velocity{1, 1});
+        const EntityID Mover = Source.NewEntity().GetID();
+        Source.Set(Mover, Health{2});
+        ChangeTick Since = Replicate(Source, Mirror, 0);
+
+        Source.Set(Mover, Health{3});
+        Source.Set(Mover, Velocity{4, 4});
+        Since = Replicate(Source, Mirror, Since);
+        ECS_CHECK(Mirrors(Source, Mirror));
+        ECS_CHECK(HealthOf(Mirror, Mover) == 3);
+    }
+}
+
+// Rounds of spawns, writes, moves and deletes, the mirror matching the source after every delta
+ECS_TEST(DeltaRoundTripsMixedChanges)
+{
+    for (size_t ChunkBytes : ChunkSizes)
+    {
+        World Source(TrackingConfig(ChunkBytes));
+        World Mirror;
+        std::vector<EntityID> IDs;
+        ChangeTick Since = 0;
+        uint32_t Seed = 1;
+        auto Next = [&Seed](size_t Bound)
+        {
+            Seed = Seed * 1664525u + 1013904223u;
+            return static_cast<size_t>(Seed >> 8) % Bound;
+        };
+        for (int Round = 0; Round < 20; Round++)
+        {
+            Source.Spawn<Health>(50, [&](World*, EntityID Entity, Health& Value)
+            {
+                Value.Value = Round;
+                IDs.push_back(Entity);
+            });
+            for (int i = 0; i < 40; i++)
+            {
+                const EntityID Entity = IDs[Next(IDs.size())];
+                switch (Next(4))
+                {
+                case 0:
+                    Source.Set(Entity, Health{static_cast<int>(Next(1000))});
+                    break;
+                case 1:
+                    Source.Set(Entity, Velocity{static_cast<float>(Next(100)), 1});
+                    break;
+                case 2:
+                    Source.Remove<Velocity>(Entity);
+                    break;
+                default:
+                    Source.Delete(Entity);
+                    break;
+                }
+            }
+            Since = Replicate(Source, Mirror, Since);
+            ECS_CHECK(Mirrors(Source, Mirror));
+        }
+    }
+}
@@ -0,0 +1,226 @@
+﻿#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "Entity.h"
+#include "TestHarness.h"
+#include "TestComponents.h"
+#include "World.h"
+
+// Relation that does not cascade, its sources only lose the pair
+struct Likes
+{
+};
+
+static EntityID MakeNode(World& Wld)
+{
+    const EntityID Entity = Wld.NewEntity().GetID();
+    Wld.Set(Entity, Position{0, 0});
+    return Entity;
+}
+
+// True when ForEachInHierarchy visits every entity having Position exactly once and after its ChildOf target
+static bool VisitsParentsFirst(World& Wld, const std::vector<EntityID>& Nodes)
+{
+    std::map<EntityID, size_t> Visited;
+    Wld.ForEachInHierarchy<ChildOf, const Position>([&](World*, EntityID Entity, const Position&)
+    {
+        Visited.emplace(Entity, Visited.size());
+    });
+    bool Ordered = Visited.size() == Nodes.size();
+    for (const EntityID Node : Nodes)
+    {
+        const EntityID Parent = Wld.GetTarget<ChildOf>(Node);
+        Ordered = Ordered && Visited.count(Node) == 1
+            && (Parent == 0 || (Visited.count(Parent) == 1 && Visited[Parent] < Visited[Node]));
+    }
+    return Ordered;
+}
+
+ECS_TEST(HierarchyVisitsParentsFirst)
+{
+    World Wld;
+    // Children are made before their parents, so creation order is no help
+    std::vector<EntityID> Nodes;
+    for (int i = 0; i < 40; i++)
+    {
+        Nodes.push_back(MakeNode(Wld));
+    }
+    for (size_t i = 0; i + 1 < Nodes.size(); i++)
+    {
+        Wld.AddPair<ChildOf>(Nodes[i], Nodes[(i + Nodes.size()) / 2]);
+    }
+    ECS_CHECK(VisitsParentsFirst(Wld, Nodes));
+    ECS_CHECK(Wld.GetTarget<ChildOf>(Nodes[0]) == Nodes[Nodes.size() / 2]);
+    ECS_CHECK(Wld.GetTarget<ChildOf>(Nodes.back()) == 0);
+}
+
+// The order is kept between passes, it must still follow a target moving into an existing archetype at another
+// depth, which makes no archetype and changes no pair of the sources
+ECS_TEST(HierarchyFollowsMovedTargets)
+{
+    World Wld;
+    const EntityID Root = MakeNode(Wld);
+    const EntityID Middle = MakeNode(Wld);
+    const EntityID Deep = MakeNode(Wld);
+    Wld.AddPair<ChildOf>(Middle, Root);
+    Wld.AddPair<ChildOf>(Deep, Middle);
+    const EntityID Other = MakeNode(Wld);
+    const EntityID Leaf = MakeNode(Wld);
+    Wld.AddPair<ChildOf>(Leaf, Other);
+    const std::vector<EntityID> Nodes = {Root, Middle, Deep, Other, Leaf};
+    ECS_CHECK(VisitsParentsFirst(Wld, Nodes));
+
+    // Other joins Deep's archetype, so Leaf's archetype goes from depth 1 to 3
+    Wld.AddPair<ChildOf>(Other, Middle);
+    ECS_CHECK(VisitsParentsFirst(Wld, Nodes));
+
+    Wld.RemovePair<ChildOf>(Other);
+    ECS_CHECK(Wld.GetTarget<ChildOf>(Other) == 0);
+    ECS_CHECK(VisitsParentsFirst(Wld, Nodes));
+}
+
+ECS_TEST(DeleteCascadesThroughChildOf)
+{
+    World Wld;
+    const EntityID Root = MakeNode(Wld);
+    const EntityID Child = MakeNode(Wld);
+    const EntityID Grandchild = MakeNode(Wld);
+    const EntityID Fan = MakeNode(Wld);
+    Wld.AddPair<ChildOf>(Child, Root);
+    Wld.AddPair<ChildOf>(Grandchild, Child);
+    Wld.AddPair<Likes>(Fan, Child);
+
+    Wld.Delete(Root);
+    ECS_CHECK(!Wld.IsAlive(Child));
+    ECS_CHECK(!Wld.IsAlive(Grandchild));
+    ECS_CHECK(Wld.IsAlive(Fan));
+    ECS_CHECK(Wld.GetTarget<Likes>(Fan) == 0);
+    ECS_CHECK(Wld.Get<Position>(Fan) != nullptr);
+    ECS_CHECK(VisitsParentsFirst(Wld, {Fan}));
+}
+
+ECS_TEST(PairsAddedFromSystemsApplyAfterTheStage)
+{
+    World Wld;
+    const EntityID Parent = MakeNode(Wld);
+    const EntityID Child = MakeNode(Wld);
+    Wld.Set(Child, Health{0});
+    Wld.AddSystem<const Health>([&](World* Wrld, EntityID Entity, const Health&)
+    {
+        Wrld->AddPair<ChildOf>(Entity, Parent);
+    });
+    Wld.Tick();
+    ECS_CHECK(Wld.GetTarget<ChildOf>(Child) == Parent);
+}
+
+// Building and deleting the same shape of tree over and over reuses the same pair IDs
+ECS_TEST(PairIDsRecycledAfterTargetsDie)
+{
+    World Wld;
+    size_t Registered = 0;
+    for (int Round = 0; Round < 20; Round++)
+    {
+        std::vector<EntityID> Parents;
+        for (int i = 0; i < 16; i++)
+        {
+            Parents.push_back(MakeNode(Wld));
+            for (int c = 0; c < 4; c++)
+            {
+                Wld.AddPair<ChildOf>(MakeNode(Wld), Parents.back());
+            }
+        }
+        for (const EntityID Parent : Parents)
+        {
+            Wld.Delete(Parent);
+        }
+        Wld.Tick();
+        if (Round == 0)
+        {
+            Registered = GetComponentCount();
+        }
+    }
+    ECS_CHECK(GetComponentCount() == Registered);
+}
+
+// Compact releases the pairs of dead targets without waiting for a Tick
+ECS_TEST(CompactReleasesDeadPairs)
+{
+    World Wld;
+    std::vector<EntityID> Parents;
+    for (int i = 0; i < 16; i++)
+    {
+        Parents.push_back(MakeNode(Wld));
+        Wld.AddPair<Likes>(MakeNode(Wld), Parents.back());
+    }
+    const size_t Registered = GetComponentCount();
+    for (const EntityID Parent : Parents)
+    {
+        Wld.Delete(Parent);
+    }
+    Wld.Compact();
+    for (int i = 0; i < 16; i++)
+    {
+        Wld.AddPair<Likes>(MakeNode(Wld), MakeNode(Wld));
+    }
+    ECS_CHECK(GetComponentCount() == Registered);
+}
+
+// A world gives its pairs back when destroyed, so worlds made one after another share the same IDs
+ECS_TEST(PairIDsOwnedPerWorld)
+{
+    size_t Registered = 0;
+    for (int Round = 0; Round < 5; Round++)
+    {
+        World Wld;
+        const EntityID Parent = MakeNode(Wld);
+        for (int i = 0; i < 8; i++)
+        {
+            const EntityID Target = MakeNode(Wld);
+            Wld.AddPair<ChildOf>(Target, Parent);
+            Wld.AddPair<Likes>(MakeNode(Wld), Target);
+        }
+        if (Round == 0)
+        {
+            Registered = GetComponentCount();
+        }
+    }
+    ECS_CHECK(GetComponentCount() == Registered);
+
+    // Two live worlds each hold their own pair for the same target index, releasing and reusing one leaves the
+    // other alone
+    World First;
+    World Second;
+    const EntityID FirstTarget = MakeNode(First);
+    First.AddPair<ChildOf>(MakeNode(First), FirstTarget);
+    const EntityID SecondTarget = MakeNode(Second);
+    const EntityID SecondChild = MakeNode(Second);
+    Second.AddPair<ChildOf>(SecondChild, SecondTarget);
+    First.Delete(FirstTarget);
+    First.Tick();
+    First.AddPair<Likes>(MakeNode(First), MakeNode(First));
+    ECS_CHECK(Second.GetTarget<ChildOf>(SecondChild) == SecondTarget);
+    ECS_CHECK(VisitsParentsFirst(Second, {SecondTarget, SecondChild}));
+}
+
+ECS_TEST(PairsSurviveSnapshots)
+{
+    const char* Path = "simpleecs_test_pairs.bin";
+    World Source;
+    const EntityID Root = MakeNode(Source);
+    const EntityID Child = MakeNode(Source);
+    const EntityID Fan = MakeNode(Source);
+    Source.AddPair<ChildOf>(Child, Root);
+    Source.AddPair<Likes>(Fan, Child);
+    ECS_CHECK(Source.SaveSnapshot(Path));
+
+    World Loaded;
+    ECS_CHECK(Loaded.LoadSnapshot(Path));
+    std::remove(Path);
+    ECS_CHECK(Loaded.GetTarget<ChildOf>(Child) == Root);
+    ECS_CHECK(Loaded.GetTarget<Likes>(Fan) == Child);
+    ECS_CHECK(VisitsParentsFirst(Loaded, {Root, Child, Fan}));
+    Loaded.Delete(Root);
+    ECS_CHECK(!Loaded.IsAlive(Child));
+    ECS_CHECK(Loaded.IsAlive(Fan) && Loaded.GetTarget<Likes>(Fan) == 0);
+}
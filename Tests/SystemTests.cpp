@@ -0,0 +1,71 @@
+﻿#include "ChangeFilters.h"
+#include "Entity.h"
+#include "TestHarness.h"
+#include "TestComponents.h"
+#include "World.h"
+
+// A system of one world spawning into another: the other world's changes and ticks must stay its own even though
+// they happen on a thread running a system of the first
+ECS_TEST(SystemChangesStayInTheirWorld)
+{
+    World A;
+    World B;
+    const EntityID Local = A.NewEntity().GetID();
+    A.Set(Local, Position{0, 0});
+    // Push A's ticks well past B's, a write stamped with A's tick would then look new to B forever
+    for (int i = 0; i < 50; i++)
+    {
+        A.Tick();
+    }
+
+    EntityID Spawned = 0;
+    A.AddSystem<Position>([&](World*, EntityID, Position&)
+    {
+        if (Spawned != 0)
+        {
+            return;
+        }
+        B.Spawn<Position>(1, [&](World* Other, EntityID Entity, Position&)
+        {
+            Other->Set(Entity, Velocity{1, 2});
+            Spawned = Entity;
+        });
+    });
+    A.Tick();
+
+    ECS_CHECK(Spawned != 0);
+    ECS_CHECK(B.Get<Velocity>(Spawned) != nullptr);
+    ECS_CHECK(A.Get<Velocity>(Local) == nullptr);
+
+    size_t Seen = 0;
+    B.AddSystem<Changed<Velocity>>([&](Velocity&) { Seen++; });
+    B.Tick();
+    ECS_CHECK(Seen == 1);
+    B.Tick();
+    ECS_CHECK(Seen == 1);
+}
+
+// Two worlds ticking on the same thread one inside the other each apply their own deferred changes
+ECS_TEST(NestedTicksKeepTheirBuffers)
+{
+    World A;
+    World B;
+    const EntityID InA = A.NewEntity().GetID();
+    A.Set(InA, Health{1});
+    const EntityID InB = B.NewEntity().GetID();
+    B.Set(InB, Health{1});
+
+    B.AddSystem<Health>([](World* Wld, EntityID Entity, Health&)
+    {
+        Wld->Set(Entity, Velocity{3, 4});
+    });
+    A.AddSystem<Health>([&](World* Wld, EntityID Entity, Health&)
+    {
+        B.Tick();
+        Wld->Set(Entity, Position{5, 6});
+    });
+    A.Tick();
+
+    ECS_CHECK(A.Get<Position>(InA) != nullptr && A.Get<Velocity>(InA) == nullptr);
+    ECS_CHECK(B.Get<Velocity>(InB) != nullptr && B.Get<Position>(InB) == nullptr);
+}
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+// Components shared by the tests. Components are identified by name, so every test file uses these same types
+struct Position
+{
+    float X;
+    float Y;
+};
+
+struct Velocity
+{
+    float X;
+    float Y;
+};
+
+struct Health
+{
+    int Value;
+};
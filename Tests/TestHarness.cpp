@@ -0,0 +1,56 @@
+﻿#include "TestHarness.h"
+
+#include <cstdio>
+#include <vector>
+
+struct RegisteredTest
+{
+    std::string Name;
+    TestFunction Func;
+};
+
+static std::vector<RegisteredTest>& GetTests()
+{
+    static std::vector<RegisteredTest> Tests;
+    return Tests;
+}
+
+static size_t Failures = 0;
+
+bool RegisterTest(const std::string& Name, TestFunction Func)
+{
+    GetTests().push_back({Name, Func});
+    return true;
+}
+
+void ReportFailure(const char* Expression, const char* File, int Line)
+{
+    printf("%s:%d: check failed: %s\n", File, Line, Expression);
+    Failures++;
+}
+
+// Runs every test whose name contains the first argument, or all of them. Fails if any check did
+int main(int argc, char** argv)
+{
+    const std::string Filter = argc > 1 ? argv[1] : "";
+    size_t Failed = 0;
+    size_t Run = 0;
+    for (const auto& Test : GetTests())
+    {
+        if (Test.Name.find(Filter) == std::string::npos)
+        {
+            continue;
+        }
+        const size_t Before = Failures;
+        Test.Func();
+        Run++;
+        if (Failures != Before)
+        {
+            Failed++;
+        }
+        printf("%-40s %s\n", Test.Name.c_str(), Failures != Before ? "FAILED" : "ok");
+        fflush(stdout);
+    }
+    printf("%zu of %zu tests failed\n", Failed, Run);
+    return Failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+﻿#pragma once
+#include <functional>
+#include <string>
+
+// Minimal test runner so the checks build without dependencies. Tests register themselves through ECS_TEST and
+// ECS_CHECK records a failed expectation and lets the test go on, so one run reports every broken promise
+typedef std::function<void()> TestFunction;
+
+// Returns true so registration can initialize a static
+bool RegisterTest(const std::string& Name, TestFunction Func);
+void ReportFailure(const char* Expression, const char* File, int Line);
+
+#define ECS_TEST(Name) \
+    static void Name(); \
+    [[maybe_unused]] static const bool Name##Registered = RegisterTest(#Name, Name); \
+    static void Name()
+
+#define ECS_CHECK(Expression) ((Expression) ? void() : ReportFailure(#Expression, __FILE__, __LINE__))
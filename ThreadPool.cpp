@@ -0,0 +1,148 @@
+﻿#include "ThreadPool.h"
+
+#include <algorithm>
+
+// Lets Run and the workers find their own queue when called from inside the pool
+static thread_local const ThreadPool* OwnerPool = nullptr;
+static thread_local size_t OwnQueue = 0;
+
+ThreadPool::ThreadPool(unsigned ThreadCount)
+{
+    if (ThreadCount == 0)
+    {
+        ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < ThreadCount; i++)
+    {
+        Queues.emplace_back(new WorkQueue());
+    }
+    for (unsigned i = 1; i < ThreadCount; i++)
+    {
+        Workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> Lock(SleepMutex);
+        Stopping = true;
+    }
+    WorkReady.notify_all();
+    for (auto& Worker : Workers)
+    {
+        Worker.join();
+    }
+}
+
+void ThreadPool::Run(const std::vector<std::function<void()>>& Jobs)
+{
+    if (Jobs.empty())
+    {
+        return;
+    }
+    if (Workers.empty() || Jobs.size() == 1)
+    {
+        for (auto& Job : Jobs)
+        {
+            Job();
+        }
+        return;
+    }
+
+    Batch Work;
+    Work.Remaining = Jobs.size();
+    const size_t Home = OwnerPool == this ? OwnQueue : 0;
+    Queued += Jobs.size();
+    {
+        std::lock_guard<std::mutex> Lock(Queues[Home]->Mutex);
+        for (auto& Job : Jobs)
+        {
+            Queues[Home]->Tasks.push_back({&Job, &Work});
+        }
+    }
+    {
+        std::lock_guard<std::mutex> Lock(SleepMutex);
+    }
+    WorkReady.notify_all();
+
+    while (Work.Remaining > 0)
+    {
+        if (!TryRunOne(Home))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+unsigned ThreadPool::GetThreadCount() const
+{
+    return static_cast<unsigned>(Queues.size());
+}
+
+unsigned ThreadPool::GetCurrentThreadIndex() const
+{
+    return OwnerPool == this ? static_cast<unsigned>(OwnQueue) : 0;
+}
+
+void ThreadPool::WorkerLoop(size_t QueueIndex)
+{
+    OwnerPool = this;
+    OwnQueue = QueueIndex;
+    while (true)
+    {
+        if (TryRunOne(QueueIndex))
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> Lock(SleepMutex);
+        WorkReady.wait(Lock, [&]() { return Stopping || Queued > 0; });
+        if (Stopping && Queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::TryRunOne(size_t QueueIndex)
+{
+    Task Next;
+    if (!Pop(QueueIndex, Next) && !Steal(QueueIndex, Next))
+    {
+        return false;
+    }
+    Queued--;
+    (*Next.Job)();
+    // Last touch of the batch, its owner may return from Run as soon as this hits zero
+    Next.Owner->Remaining--;
+    return true;
+}
+
+bool ThreadPool::Pop(size_t QueueIndex, Task& Out)
+{
+    WorkQueue& Queue = *Queues[QueueIndex];
+    std::lock_guard<std::mutex> Lock(Queue.Mutex);
+    if (Queue.Tasks.empty())
+    {
+        return false;
+    }
+    Out = Queue.Tasks.back();
+    Queue.Tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::Steal(size_t QueueIndex, Task& Out)
+{
+    for (size_t Offset = 1; Offset < Queues.size(); Offset++)
+    {
+        WorkQueue& Victim = *Queues[(QueueIndex + Offset) % Queues.size()];
+        std::lock_guard<std::mutex> Lock(Victim.Mutex);
+        if (!Victim.Tasks.empty())
+        {
+            Out = Victim.Tasks.front();
+            Victim.Tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool. Every worker owns a deque it pops from the back of while idle threads steal from the
+// front of the others. The thread calling Run keeps executing queued work until its batch is done, so Run may
+// be nested inside a job and a pool of ThreadCount 1 runs everything inline without spawning anything
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned ThreadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool& obj) = delete;
+
+    // Blocks until every job in the batch has finished
+    void Run(const std::vector<std::function<void()>>& Jobs);
+
+    unsigned GetThreadCount() const;
+    // Index of the calling thread in [0, GetThreadCount()), 0 for threads outside the pool
+    unsigned GetCurrentThreadIndex() const;
+
+private:
+    struct Batch
+    {
+        std::atomic<size_t> Remaining{0};
+    };
+
+    struct Task
+    {
+        const std::function<void()>* Job;
+        Batch* Owner;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    void WorkerLoop(size_t QueueIndex);
+    bool TryRunOne(size_t QueueIndex);
+    bool Pop(size_t QueueIndex, Task& Out);
+    bool Steal(size_t QueueIndex, Task& Out);
+
+    std::vector<std::thread> Workers;
+    // Queue 0 takes work submitted from threads outside the pool, queue i belongs to worker i
+    std::vector<std::unique_ptr<WorkQueue>> Queues;
+    std::atomic<size_t> Queued{0};
+    std::mutex SleepMutex;
+    std::condition_variable WorkReady;
+    bool Stopping = false;
+};
@@ -0,0 +1,114 @@
+﻿#include "Tracing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> TracingEnabled = false;
+
+struct TraceEvent
+{
+    const char* Name;
+    uint64_t Start;
+    uint64_t Duration;
+    int64_t Value;
+    TraceEventType Type;
+};
+
+static constexpr uint64_t TraceBufferSize = 1 << 15;
+
+// Written only by its own thread. Head counts every event ever recorded, Tail marks where the last clear happened
+struct TraceBuffer
+{
+    uint32_t ThreadIndex = 0;
+    std::atomic<uint64_t> Head = 0;
+    std::atomic<uint64_t> Tail = 0;
+    TraceEvent Events[TraceBufferSize];
+};
+
+// Buffers outlive their threads so events of finished threads can still be written out
+static std::mutex BuffersMutex;
+static std::vector<TraceBuffer*> Buffers;
+
+static TraceBuffer* GetThreadBuffer()
+{
+    static thread_local TraceBuffer* Buffer = nullptr;
+    if (Buffer == nullptr)
+    {
+        Buffer = new TraceBuffer();
+        std::lock_guard<std::mutex> Lock(BuffersMutex);
+        Buffer->ThreadIndex = static_cast<uint32_t>(Buffers.size());
+        Buffers.push_back(Buffer);
+    }
+    return Buffer;
+}
+
+void SetTracingEnabled(bool Enabled)
+{
+    TracingEnabled.store(Enabled, std::memory_order_relaxed);
+}
+
+void ClearTraceEvents()
+{
+    std::lock_guard<std::mutex> Lock(BuffersMutex);
+    for (auto Buffer : Buffers)
+    {
+        Buffer->Tail.store(Buffer->Head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+uint64_t GetTraceTime()
+{
+    static const auto Epoch = std::chrono::steady_clock::now();
+    // Offset by one so a valid start time is never 0
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch).count() + 1;
+}
+
+void RecordTraceEvent(const char* Name, TraceEventType Type, uint64_t Start, uint64_t Duration, int64_t Value)
+{
+    TraceBuffer* Buffer = GetThreadBuffer();
+    const uint64_t Head = Buffer->Head.load(std::memory_order_relaxed);
+    Buffer->Events[Head % TraceBufferSize] = {Name, Start, Duration, Value, Type};
+    Buffer->Head.store(Head + 1, std::memory_order_release);
+}
+
+bool WriteChromeTrace(const char* Path)
+{
+    FILE* Out = fopen(Path, "w");
+    if (Out == nullptr)
+    {
+        return false;
+    }
+    fprintf(Out, "{\"traceEvents\":[\n");
+    bool First = true;
+    std::lock_guard<std::mutex> Lock(BuffersMutex);
+    for (auto Buffer : Buffers)
+    {
+        const uint64_t Head = Buffer->Head.load(std::memory_order_acquire);
+        uint64_t Begin = Buffer->Tail.load(std::memory_order_relaxed);
+        if (Head - Begin > TraceBufferSize)
+        {
+            Begin = Head - TraceBufferSize;
+        }
+        for (uint64_t i = Begin; i < Head; i++)
+        {
+            const TraceEvent& Event = Buffer->Events[i % TraceBufferSize];
+            fprintf(Out, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                First ? "" : ",\n", Event.Name, static_cast<char>(Event.Type), Event.Start / 1000.0,
+                Buffer->ThreadIndex);
+            if (Event.Type == TraceEventType::Complete)
+            {
+                fprintf(Out, ",\"dur\":%.3f", Event.Duration / 1000.0);
+            }
+            else if (Event.Type == TraceEventType::Instant)
+            {
+                fprintf(Out, ",\"s\":\"t\"");
+            }
+            fprintf(Out, ",\"args\":{\"value\":%lld}}", static_cast<long long>(Event.Value));
+            First = false;
+        }
+    }
+    fprintf(Out, "\n]}\n");
+    return fclose(Out) == 0;
+}
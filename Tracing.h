@@ -0,0 +1,73 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Profiling events for ticks. Only compiled in when SIMPLEECS_TRACING is defined, otherwise the ECS_TRACE macros
+// expand to nothing and their arguments are never evaluated. Compiled in tracing still records nothing until
+// SetTracingEnabled(true), so a shipped build can be profiled without rebuilding it.
+// Every thread records into its own fixed size ring buffer without taking locks, the oldest events are
+// overwritten once it is full. The events are written out as Chrome trace JSON, which Perfetto also loads
+
+void SetTracingEnabled(bool Enabled);
+// Drops every event recorded so far
+void ClearTraceEvents();
+// Call between ticks, events recorded while writing may be torn. Returns false if the file could not be written
+bool WriteChromeTrace(const char* Path);
+
+extern std::atomic<bool> TracingEnabled;
+
+inline bool IsTracingEnabled()
+{
+    return TracingEnabled.load(std::memory_order_relaxed);
+}
+
+enum class TraceEventType : char
+{
+    Complete = 'X',
+    Instant = 'i',
+    Counter = 'C',
+};
+
+uint64_t GetTraceTime();
+// Name must outlive the trace, string literals are expected
+void RecordTraceEvent(const char* Name, TraceEventType Type, uint64_t Start, uint64_t Duration, int64_t Value);
+
+// Records the time spent in its scope along with Value
+class TraceScope
+{
+public:
+    TraceScope(const char* Name, int64_t Value):
+        Name(Name),
+        Value(Value),
+        Start(IsTracingEnabled() ? GetTraceTime() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (Start != 0)
+        {
+            RecordTraceEvent(Name, TraceEventType::Complete, Start, GetTraceTime() - Start, Value);
+        }
+    }
+    TraceScope(const TraceScope& obj) = delete;
+
+private:
+    const char* Name;
+    int64_t Value;
+    uint64_t Start;
+};
+
+#ifdef SIMPLEECS_TRACING
+#define ECS_TRACE_JOIN2(A, B) A##B
+#define ECS_TRACE_JOIN(A, B) ECS_TRACE_JOIN2(A, B)
+#define ECS_TRACE_SCOPE(Name, Value) TraceScope ECS_TRACE_JOIN(TraceScope, __LINE__)(Name, static_cast<int64_t>(Value))
+#define ECS_TRACE_INSTANT(Name, Value) \
+    (IsTracingEnabled() ? RecordTraceEvent(Name, TraceEventType::Instant, GetTraceTime(), 0, static_cast<int64_t>(Value)) : void())
+#define ECS_TRACE_COUNTER(Name, Value) \
+    (IsTracingEnabled() ? RecordTraceEvent(Name, TraceEventType::Counter, GetTraceTime(), 0, static_cast<int64_t>(Value)) : void())
+#else
+#define ECS_TRACE_SCOPE(Name, Value) ((void)0)
+#define ECS_TRACE_INSTANT(Name, Value) ((void)0)
+#define ECS_TRACE_COUNTER(Name, Value) ((void)0)
+#endif
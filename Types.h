@@ -1,6 +1,28 @@
 ﻿#pragma once
-#include <unordered_set>
+#include <cstdint>
 
 typedef int ComponentID;
-typedef int EntityID;
-typedef std::unordered_set<ComponentID> ArchSignature ;
+constexpr ComponentID InvalidComponentID = -1;
+
+// Stamp of a write, used by change filters. Every system run and every unlocked change gets a newer one, so a
+// system has seen everything stamped at or before its own last run. 0 predates every write
+typedef uint64_t ChangeTick;
+
+// Generational handle: slot index in the low half, generation of that slot in the high half.
+// Slot 0 is never handed out so a zero EntityID is always invalid
+typedef uint64_t EntityID;
+
+inline uint32_t GetEntityIndex(EntityID Entity)
+{
+    return static_cast<uint32_t>(Entity);
+}
+
+inline uint32_t GetEntityGeneration(EntityID Entity)
+{
+    return static_cast<uint32_t>(Entity >> 32);
+}
+
+inline EntityID MakeEntityID(uint32_t Index, uint32_t Generation)
+{
+    return static_cast<EntityID>(Generation) << 32 | Index;
+}
@@ -1,41 +1,146 @@
 ﻿#include "World.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+
 #include "Types.h"
 #include "Entity.h"
 #include "ErrorHandling.h"
+#include "Tracing.h"
+
+CommandBuffer::CommandBuffer(std::pmr::memory_resource* Resource):
+    Allocator(Resource),
+    Commands(Resource)
+{
+}
+
+CommandBuffer::~CommandBuffer()
+{
+    Clear();
+}
+
+void CommandBuffer::Spawn(EntityID Entity)
+{
+    Commands.push_back({Entity, InvalidComponentID, CommandType::Spawn, nullptr});
+}
+
+void CommandBuffer::Set(EntityID Entity, ComponentID Type, const void* Data)
+{
+    const ComponentInfo& Info = GetComponentInfo(Type);
+    void* Value = Allocator.allocate_bytes(Info.Size, Info.Alignment);
+    if (Info.CopyConstruct != nullptr)
+    {
+        Info.CopyConstruct(Value, Data);
+    }
+    else
+    {
+        memcpy(Value, Data, Info.Size);
+    }
+    Commands.push_back({Entity, Type, CommandType::Set, Value});
+}
+
+void CommandBuffer::Remove(EntityID Entity, ComponentID Type)
+{
+    Commands.push_back({Entity, Type, CommandType::Remove, nullptr});
+}
 
-SetQueue::SetQueue(IStorage* Storage)
+void CommandBuffer::Delete(EntityID Entity)
 {
-    EntityIDs = new VectorStorage<EntityID>();
-    ComponentBuffer = Storage;
+    Commands.push_back({Entity, InvalidComponentID, CommandType::Delete, nullptr});
 }
 
-SetQueue::~SetQueue()
+void CommandBuffer::AddPair(EntityID Entity, ComponentID Relation, EntityID Target)
 {
-    delete EntityIDs;
-    delete ComponentBuffer;
+    void* Value = Allocator.allocate_bytes(sizeof(EntityID), alignof(EntityID));
+    memcpy(Value, &Target, sizeof(EntityID));
+    Commands.push_back({Entity, Relation, CommandType::AddPair, Value});
 }
 
-void SetQueue::Enqueue(EntityID Entity, const void* Data) const
+void CommandBuffer::Append(CommandBuffer& Other)
 {
-    EntityIDs->AddRawData(&Entity);
-    ComponentBuffer->AddRawData(Data);
+    Commands.insert(Commands.end(), Other.Commands.begin(), Other.Commands.end());
+    // The values now belong to this buffer
+    Other.Commands.clear();
+}
+
+void CommandBuffer::Clear()
+{
+    for (const Command& Cmd : Commands)
+    {
+        if (Cmd.Value == nullptr)
+        {
+            continue;
+        }
+        const ComponentInfo& Info = GetComponentInfo(Cmd.Type);
+        if (Info.Destroy != nullptr)
+        {
+            Info.Destroy(Cmd.Value, 1);
+        }
+    }
+    Commands.clear();
 }
 
-void SetQueue::ForEach(std::function<void(EntityID&, void*)> Handler)
+[[maybe_unused]] static size_t CountRows(const std::vector<Archetype*>& Archetypes)
 {
-    for (size_t i = 0; i < EntityIDs->GetSize(); i++)
+    size_t Count = 0;
+    for (auto Arch : Archetypes)
     {
-        EntityID* Id = static_cast<EntityID*>(EntityIDs->GetRawData(i));
-        void* Data = ComponentBuffer->GetRawData(i);
-        Handler(*Id, Data);
+        Count += Arch->GetEntityCount();
     }
+    return Count;
+}
+
+// What the system, chunk or flush running on this thread belongs to. Only its own world uses it, any other world
+// touched from inside a system behaves as if called from outside
+struct ActiveContext
+{
+    const World* Owner = nullptr;
+    // Buffer slot of the running system or chunk. Slots are filled on first use so chunks that never change
+    // anything cost no allocation
+    CommandBuffer** Buffer = nullptr;
+    // Change tick of the running system or flush, 0 when there is none
+    ChangeTick Tick = 0;
+    // System whose handler is running, null outside Tick
+    const System* Running = nullptr;
+};
+static thread_local ActiveContext Active;
+
+World::World(): World(WorldConfig())
+{
 }
 
-World::World()
+World::World(const WorldConfig& Config):
+    Resource(Config.Resource != nullptr ? Config.Resource : std::pmr::get_default_resource()),
+    Allocator(Resource),
+    Archetypes(Resource),
+    ArchetypeLookup(Resource),
+    ChunkBytes(Config.ChunkBytes),
+    CompactBudget(Config.CompactBudget),
+    ArchetypesByComponent(Resource),
+    QueriesByComponent(Resource),
+    UnindexedQueries(Resource),
+    Queries(Resource),
+    SparsePools(Resource),
+    SparsePoolList(Resource),
+    PairsByTarget(Resource),
+    DeadPairs(Resource),
+    Slots(Resource),
+    FreeSlots(Resource),
+    TrackDeltas(Config.TrackDeltas),
+    DeletedLog(Resource),
+    SystemBuffers(Resource),
+    CommandArenas(Resource),
+    Workers(Config.ThreadCount)
 {
-    Archetype* Empty = new Archetype();
-    Graveyard = new VectorStorage<EntityID>();
+    for (unsigned i = 0; i < Workers.GetThreadCount(); i++)
+    {
+        CommandArenas.push_back(Allocator.new_object<BumpArena>(Resource));
+    }
+    Archetype* Empty = Allocator.new_object<Archetype>(ArchSignature(), ChunkBytes, Resource);
+    // Slot 0 stays unused so a zero EntityID is never valid
+    Slots.resize(1);
 
     Archetypes.emplace_back(Empty);
     ArchSignature Sig = *Empty->GetSignature();
@@ -44,186 +149,1432 @@ World::World()
 
 World::~World()
 {
-    for (auto Archetype : Archetypes)
+    // Submissions nobody flushed are dropped
+    for (SubmittedCommands* Commands = Submitted.exchange(nullptr); Commands != nullptr;)
+    {
+        SubmittedCommands* Next = Commands->Next;
+        Allocator.delete_object(Commands);
+        Commands = Next;
+    }
+    ReleaseCommandBuffers();
+    for (auto Cached : Queries)
+    {
+        Allocator.delete_object(Cached);
+    }
+    for (auto Arena : CommandArenas)
+    {
+        Allocator.delete_object(Arena);
+    }
+    for (auto Pool : SparsePoolList)
     {
-        delete Archetype;
+        Allocator.delete_object(Pool);
     }
-    delete Graveyard;
-    for (auto Kvp : SetQueues)
+    for (auto Archetype : Archetypes)
     {
-        delete Kvp.second;
+        Allocator.delete_object(Archetype);
     }
-    for (auto Kvp : RemoveQueues)
+    // The pairs this world took from the registry go back for other worlds to reuse
+    for (const auto& Pairs : PairsByTarget)
     {
-        delete Kvp.second;
+        for (const auto Pair : Pairs)
+        {
+            ReleasePairComponent(Pair);
+        }
     }
 }
 
 Entity World::NewEntity()
 {
-    EntityID E = NextEntityID++;
-    EntityArchetypeLookup.emplace(E, 0);
-    Archetypes[0]->CopyEntity(E, nullptr, 0, nullptr);
+    EntityID E = AllocateEntity();
+    if (WorldLock)
+    {
+        GetCommandBuffer()->Spawn(E);
+        return Entity(this, E);
+    }
+    AddEntity(E);
     return Entity(this, E);
 }
 
-void World::Set(EntityID Entity, ComponentID Type, const void* Data)
+bool World::IsAlive(const EntityID& Entity) const
 {
-    if (WorldLock)
+    return FindSlot(Entity) != nullptr;
+}
+
+void World::PlaceEntity(const EntityID& Entity, Archetype* Target)
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (FindSlot(Entity) == nullptr)
+    {
+        NextSlot = std::max<uint32_t>(NextSlot, Index + 1);
+        if (Index < Slots.size() && Slots[Index].Arch != nullptr)
+        {
+            // Still holds an older entity whose delete never arrived
+            Delete(MakeEntityID(Index, Slots[Index].Generation));
+        }
+        AddEntity(Entity);
+        Slots[Index].Generation = GetEntityGeneration(Entity);
+    }
+    if (Slots[Index].Arch != Target)
+    {
+        MoveEntity(Entity, Target, InvalidComponentID, nullptr);
+    }
+}
+
+EntityID World::AllocateEntity()
+{
+    // Recycled slots are only handed out while unlocked, locked callers may be on any thread and only bump
+    // the counter
+    while (!WorldLock && !FreeSlots.empty())
     {
-        auto Queue = SetQueues[Type];
-        if (Queue == nullptr)
+        const uint32_t Index = FreeSlots.back();
+        FreeSlots.pop_back();
+        // Applied deltas may have put an entity back into a freed slot
+        if (Slots[Index].Arch == nullptr)
         {
-            Queue = SetQueues[Type] = new SetQueue(MakeStorageForID(Type));
+            return MakeEntityID(Index, Slots[Index].Generation);
         }
-        Queue->Enqueue(Entity, Data);
+    }
+    return MakeEntityID(NextSlot++, 0);
+}
+
+EntityID World::ReserveEntity()
+{
+    // Free slots belong to the thread owning the world, so reservations always take a fresh one
+    return MakeEntityID(NextSlot++, 0);
+}
+
+void World::ReleaseReserved(const EntityID& Entity)
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Slots.size())
+    {
+        Slots.resize(NextSlot);
+    }
+    EntitySlot& Slot = Slots[Index];
+    // Placed some other way since, by an applied delta
+    if (Slot.Arch != nullptr || Slot.Generation != GetEntityGeneration(Entity))
+    {
         return;
     }
-        
-    Archetype* CurrentArchetype = Archetypes[EntityArchetypeLookup[Entity]];
-    auto ContainsType = CurrentArchetype->GetSignature()->find(Type);
+    // The producer may still hold the ID
+    Slot.Generation++;
+    FreeSlots.push_back(Index);
+}
 
-    //Not in current archetype. Move entity to new table.
-    if (ContainsType == CurrentArchetype->GetSignature()->end())
+void World::AddEntity(const EntityID& Entity)
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Slots.size())
     {
-        CurrentArchetype = ChangeEntityType(Entity, Type, Data);
+        Slots.resize(NextSlot);
     }
+    EntitySlot& Slot = Slots[Index];
+    Slot.Arch = Archetypes[0];
+    Slot.PlacedTick = GetWriteTick();
+    Slot.Row = Archetypes[0]->CopyEntity(Entity, nullptr, 0, InvalidComponentID, nullptr, Slot.PlacedTick);
+}
 
-    CurrentArchetype->SetValue(Entity, Type, Data);
+World::EntitySlot* World::FindSlot(const EntityID& Entity)
+{
+    return const_cast<EntitySlot*>(static_cast<const World*>(this)->FindSlot(Entity));
 }
 
-void* World::Get(const EntityID& Entity, ComponentID Type)
+const World::EntitySlot* World::FindSlot(const EntityID& Entity) const
 {
-    Archetype* CurrentArchetype = Archetypes[EntityArchetypeLookup[Entity]];
-    auto ContainsType = CurrentArchetype->GetSignature()->find(Type);
-        
-    if(ContainsType == CurrentArchetype->GetSignature()->end())
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index >= Slots.size())
     {
         return nullptr;
     }
-    void* result = CurrentArchetype->GetValue(Entity, Type);
-    return result;
+    const EntitySlot& Slot = Slots[Index];
+    if (Slot.Arch == nullptr || Slot.Generation != GetEntityGeneration(Entity))
+    {
+        return nullptr;
+    }
+    return &Slot;
 }
 
-void World::Remove(const EntityID& Entity, ComponentID Type)
+Archetype* World::SpawnRows(const ArchSignature& Signature, size_t Count)
 {
     if (WorldLock)
     {
-        auto Queue = RemoveQueues[Type];
-        if (Queue == nullptr)
+        Error("Cannot spawn while world is locked\n");
+    }
+    Archetype* Arch = FindOrAddArchetype(&Signature);
+    std::pmr::vector<EntityID> IDs(Count, Resource);
+    for (size_t i = 0; i < Count; i++)
+    {
+        IDs[i] = AllocateEntity();
+    }
+    Slots.resize(NextSlot);
+    const ChangeTick Tick = GetWriteTick();
+    const size_t FirstRow = Arch->AddEntities(IDs.data(), Count, Tick);
+    for (size_t i = 0; i < Count; i++)
+    {
+        EntitySlot& Slot = Slots[GetEntityIndex(IDs[i])];
+        Slot.Arch = Arch;
+        Slot.Row = FirstRow + i;
+        Slot.PlacedTick = Tick;
+    }
+    return Arch;
+}
+
+CommandBuffer* World::GetCommandBuffer()
+{
+    CommandBuffer** Slot = Active.Owner != this || Active.Buffer == nullptr ? &MainBuffer : Active.Buffer;
+    if (*Slot == nullptr)
+    {
+        *Slot = NewCommandBuffer();
+    }
+    return *Slot;
+}
+
+ChangeTick World::GetWriteTick()
+{
+    return Active.Owner == this && Active.Tick != 0 ? Active.Tick : ++CurrentTick;
+}
+
+BumpArena* World::GetCommandArena()
+{
+    return CommandArenas[Workers.GetCurrentThreadIndex()];
+}
+
+CommandBuffer* World::NewCommandBuffer()
+{
+    BumpArena* Arena = GetCommandArena();
+    return std::pmr::polymorphic_allocator<>(Arena).new_object<CommandBuffer>(Arena);
+}
+
+void World::ReleaseCommandBuffers()
+{
+    // Buffer memory belongs to the arenas, only the destructors need running
+    for (auto& Buffer : SystemBuffers)
+    {
+        if (Buffer != nullptr)
         {
-            Queue = RemoveQueues[Type] = new VectorStorage<EntityID>();
+            std::destroy_at(Buffer);
+            Buffer = nullptr;
         }
-        Queue->AddRawData(&Entity);
-        return;
     }
-    ChangeEntityType(Entity, Type, nullptr);
+    if (MainBuffer != nullptr)
+    {
+        std::destroy_at(MainBuffer);
+        MainBuffer = nullptr;
+    }
+    for (auto Arena : CommandArenas)
+    {
+        Arena->Reset();
+    }
 }
 
-void World::Delete(const EntityID& Entity)
+const std::pmr::vector<Archetype*>& World::GetArchetypesWith(ComponentID Type)
 {
-    if (WorldLock)
+    if (static_cast<size_t>(Type) >= ArchetypesByComponent.size())
     {
-        Graveyard->AddRawData(&Entity);
-        return;
+        ArchetypesByComponent.resize(Type + 1);
     }
-    Archetype* CurrentArchetype = Archetypes[EntityArchetypeLookup[Entity]];
-    CurrentArchetype->FastDelete(Entity);
-    EntityArchetypeLookup.erase(Entity);
+    return ArchetypesByComponent[Type];
 }
 
-Archetype* World::FindOrAddArchetype(const ArchSignature* Signature)
+const std::pmr::vector<Archetype*>& World::GetCandidates(const ArchSignature& Signature)
 {
-    if (WorldLock)
+    const std::pmr::vector<Archetype*>* Rarest = &Archetypes;
+    for (const auto Type : Signature)
     {
-        Error("Cannot make new archetypes while world is locked");
+        const std::pmr::vector<Archetype*>& With = GetArchetypesWith(Type);
+        if (With.size() < Rarest->size())
+        {
+            Rarest = &With;
+        }
     }
-    auto Found = ArchetypeLookup.find(*Signature);
-    if (Found == ArchetypeLookup.end())
+    return *Rarest;
+}
+
+void World::CollectMatches(const ArchSignature& Signature, const ArchSignature& Excluded, std::vector<Archetype*>& Out)
+{
+    for (auto Arch : GetCandidates(Signature))
     {
-        Archetype* NewArch = new Archetype(*Signature);
-        ArchetypeLookup.emplace(*Signature, Archetypes.size());
-        Archetypes.emplace_back(NewArch);
-        for (auto& System : Systems)
+        if (Arch->GetSignature()->ContainsAll(Signature) && !Arch->GetSignature()->Intersects(Excluded))
         {
-            System.TryAddMatch(NewArch);
+            Out.push_back(Arch);
         }
-        return NewArch;
     }
-    return Archetypes[Found->second];
 }
 
-Archetype* World::ChangeEntityType(const EntityID& Entity, ComponentID Type, const void* Data)
+Query* World::AddQuery(const ArchSignature& All, const ArchSignature& Any, const ArchSignature& None)
 {
-    
-    Archetype* CurrentArchetype = Archetypes[EntityArchetypeLookup[Entity]];
+    for (const ArchSignature* Terms : {&All, &Any, &None})
+    {
+        for (const auto Type : *Terms)
+        {
+            if (GetComponentInfo(Type).Sparse)
+            {
+                Error("Sparse component %d is not stored in archetypes, filter on it in a typed system\n", Type);
+            }
+        }
+    }
+    Query* Cached = Allocator.new_object<Query>(All, Any, None);
+    Queries.push_back(Cached);
+    if (!All.IsEmpty())
+    {
+        // Every match has all of them, so watching the one with the fewest archetypes so far is enough
+        ComponentID Rarest = InvalidComponentID;
+        for (const auto Type : All)
+        {
+            if (Rarest == InvalidComponentID || GetArchetypesWith(Type).size() < GetArchetypesWith(Rarest).size())
+            {
+                Rarest = Type;
+            }
+        }
+        for (auto Arch : GetArchetypesWith(Rarest))
+        {
+            Cached->TryAddMatch(Arch);
+        }
+        QueriesByComponent.resize(std::max(QueriesByComponent.size(), ArchetypesByComponent.size()));
+        QueriesByComponent[Rarest].push_back(Cached);
+        return Cached;
+    }
 
-    ArchSignature NewSig = *CurrentArchetype->GetSignature();
-    if(Data == nullptr)
+    for (auto Arch : Archetypes)
+    {
+        Cached->TryAddMatch(Arch);
+    }
+    if (Any.IsEmpty())
     {
-        NewSig.erase(Type);
-    }else
+        UnindexedQueries.push_back(Cached);
+        return Cached;
+    }
+    for (const auto Type : Any)
     {
-        NewSig.emplace(Type);
+        GetArchetypesWith(Type);
+        QueriesByComponent.resize(std::max(QueriesByComponent.size(), ArchetypesByComponent.size()));
+        QueriesByComponent[Type].push_back(Cached);
     }
-    Archetype* NewArchetype = FindOrAddArchetype(&NewSig);
-    NewArchetype->CopyEntity(Entity, CurrentArchetype, Type, Data);
-    CurrentArchetype->FastDelete(Entity);
-    EntityArchetypeLookup[Entity] = ArchetypeLookup[*NewArchetype->GetSignature()];
-    
-    return NewArchetype;
+    return Cached;
 }
 
-void World::Tick()
+void World::RemoveQuery(Query* Cached)
 {
-    for (System& System : Systems)
+    auto Forget = [&](std::pmr::vector<Query*>& List)
     {
-        WorldLock = true;
-        for (auto Archetype : *System.GetMatchedArchetypes())
+        List.erase(std::remove(List.begin(), List.end(), Cached), List.end());
+    };
+    for (auto& List : QueriesByComponent)
+    {
+        Forget(List);
+    }
+    Forget(UnindexedQueries);
+    Forget(Queries);
+    Allocator.delete_object(Cached);
+}
+
+void World::Set(EntityID Entity, ComponentID Type, const void* Data)
+{
+    if (WorldLock)
+    {
+        GetCommandBuffer()->Set(Entity, Type, Data);
+        return;
+    }
+
+    EntitySlot* Slot = FindSlot(Entity);
+    if (Slot == nullptr)
+    {
+        return;
+    }
+    if (GetComponentInfo(Type).Sparse)
+    {
+        GetSparsePool(Type)->Set(Entity, Data);
+        return;
+    }
+    if (ChangePairNow(Entity, Type, true))
+    {
+        return;
+    }
+
+    //Not in current archetype. Move entity to new table.
+    if (!Slot->Arch->GetSignature()->Contains(Type))
+    {
+        ChangeEntityType(Entity, Type, Data);
+    }
+
+    Slot->Arch->SetValue(Slot->Row, Type, Data, GetWriteTick());
+}
+
+void* World::Get(const EntityID& Entity, ComponentID Type)
+{
+#ifndef NDEBUG
+    // The scheduler only sees what a system declared and may run it next to a system writing anything else
+    const System* Running = Active.Owner == this ? Active.Running : nullptr;
+    if (Running != nullptr && !Running->IsExclusive() && !Running->GetReads().Contains(Type)
+        && !Running->GetWrites().Contains(Type) && !GetComponentInfo(Type).Tag)
+    {
+        const std::string_view Name = GetComponentInfo(Type).Name;
+        Error("A system got component %.*s without declaring it in its terms\n", static_cast<int>(Name.size()),
+            Name.data());
+    }
+#endif
+    const EntitySlot* Slot = FindSlot(Entity);
+    if (Slot == nullptr)
+    {
+        return nullptr;
+    }
+    if (GetComponentInfo(Type).Sparse)
+    {
+        SparseSet* Pool = FindSparsePool(Type);
+        return Pool != nullptr ? Pool->Get(Entity) : nullptr;
+    }
+        
+    if(!Slot->Arch->GetSignature()->Contains(Type))
+    {
+        return nullptr;
+    }
+    if (GetComponentInfo(Type).Tag)
+    {
+        // Tags have no storage, every entity having one shares this address
+        static std::max_align_t TagValue;
+        return &TagValue;
+    }
+    void* result = Slot->Arch->GetValue(Slot->Row, Type);
+    // The caller may write through the pointer
+    Slot->Arch->MarkChanged(Slot->Row, Type, GetWriteTick());
+    return result;
+}
+
+void World::Remove(const EntityID& Entity, ComponentID Type)
+{
+    if (WorldLock)
+    {
+        GetCommandBuffer()->Remove(Entity, Type);
+        return;
+    }
+    const EntitySlot* Slot = FindSlot(Entity);
+    if (Slot == nullptr)
+    {
+        return;
+    }
+    if (GetComponentInfo(Type).Sparse)
+    {
+        if (SparseSet* Pool = FindSparsePool(Type))
         {
-            auto Entities = Archetype->GetEntityIDs();
-            for (int i = Entities->GetSize() - 1; i >= 0; i--)
-            {
-                EntityID* Id = static_cast<EntityID*>(Entities->GetRawData(i));
-                Entity E(this, *Id);
-                System.GetHandler()(this, E);
-            }
+            Pool->Remove(Entity);
         }
-        WorldLock = false;
+        return;
+    }
+    if (ChangePairNow(Entity, Type, false))
+    {
+        return;
+    }
+    if (!Slot->Arch->GetSignature()->Contains(Type))
+    {
+        return;
+    }
+    ChangeEntityType(Entity, Type, nullptr);
+}
+
+void World::Delete(const EntityID& Entity)
+{
+    if (WorldLock)
+    {
+        GetCommandBuffer()->Delete(Entity);
+        return;
+    }
+    EntitySlot* Slot = FindSlot(Entity);
+    if (Slot == nullptr)
+    {
+        return;
+    }
+    for (auto Pool : SparsePoolList)
+    {
+        Pool->Remove(Entity);
+    }
+    const EntityID Moved = Slot->Arch->FastDelete(Slot->Row);
+    if (Moved != 0)
+    {
+        Slots[GetEntityIndex(Moved)].Row = Slot->Row;
+    }
+    Slot->Arch = nullptr;
+    Slot->Generation++;
+    FreeSlots.push_back(GetEntityIndex(Entity));
+    TouchTarget(Entity);
+    if (TrackDeltas)
+    {
+        DeletedLog.emplace_back(Entity, GetWriteTick());
+    }
+    DeleteSources(Entity);
+}
 
-        for (auto Kvp : SetQueues)
+void World::DeleteSources(const EntityID& Target)
+{
+    const uint32_t Index = GetEntityIndex(Target);
+    if (Index >= PairsByTarget.size() || PairsByTarget[Index].empty())
+    {
+        return;
+    }
+    const std::vector<ComponentID> Pairs(PairsByTarget[Index].begin(), PairsByTarget[Index].end());
+    std::vector<EntityID> Sources;
+    for (const auto Pair : Pairs)
+    {
+        // Pairs of an earlier entity of this slot died with it
+        const ComponentInfo& Info = GetComponentInfo(Pair);
+        if (Info.Target != Target)
         {
-            Kvp.second->ForEach([&](EntityID& Entity, const void* Data)
-            {
-                this->Set(Entity, Kvp.first, Data);
-            });
-            Kvp.second->Empty();
+            continue;
         }
-
-        for (auto Kvp : RemoveQueues)
+        DeadPairs.push_back(Pair);
+        // Collected first since every delete or move reshuffles the rows
+        Sources.clear();
+        for (auto Arch : GetArchetypesWith(Pair))
         {
-            for (size_t i = 0; i < Kvp.second->GetSize(); i++)
+            for (size_t c = 0; c < Arch->GetChunkCount(); c++)
             {
-                EntityID* E = static_cast<EntityID*>(Kvp.second->GetRawData(i));
-                Remove(*E, Kvp.first);
+                const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+                Sources.insert(Sources.end(), Chunk->GetEntityIDs(), Chunk->GetEntityIDs() + Chunk->GetCount());
             }
-            Kvp.second->Empty();
         }
-
-        for(int i = Graveyard->GetSize() - 1; i >= 0; i--)
+        for (const auto Source : Sources)
         {
-            EntityID* E = static_cast<EntityID*>(Graveyard->GetRawData(i));
-            Delete(*E);
+            if (Info.Cascade)
+            {
+                Delete(Source);
+            }
+            else
+            {
+                Remove(Source, Pair);
+            }
         }
-        Graveyard->Empty();
     }
 }
 
-void World::AddSystem(System System)
+void World::AddPair(EntityID Entity, ComponentID Relation, EntityID Target)
 {
-    for (auto Archetype : Archetypes)
+    if (Entity == Target)
+    {
+        Error("Entity cannot be the target of its own relation %d\n", Relation);
+    }
+    // Pairs are made on the world's own thread only
+    if (WorldLock)
     {
-        System.TryAddMatch(Archetype);
+        GetCommandBuffer()->AddPair(Entity, Relation, Target);
+        return;
     }
+    // A pair to a dead entity would never be cleaned up
+    if (FindSlot(Entity) == nullptr || !IsAlive(Target))
+    {
+        return;
+    }
+    static const std::max_align_t NoValue{};
+    Set(Entity, GetPair(Relation, Target), &NoValue);
+}
+
+ComponentID World::FindPair(ComponentID Relation, EntityID Target) const
+{
+    const uint32_t Index = GetEntityIndex(Target);
+    if (Index >= PairsByTarget.size())
+    {
+        return InvalidComponentID;
+    }
+    for (const auto Pair : PairsByTarget[Index])
+    {
+        const ComponentInfo& Info = GetComponentInfo(Pair);
+        if (Info.Relation == Relation && Info.Target == Target)
+        {
+            return Pair;
+        }
+    }
+    return InvalidComponentID;
+}
+
+ComponentID World::GetPair(ComponentID Relation, EntityID Target)
+{
+    ComponentID Pair = FindPair(Relation, Target);
+    if (Pair != InvalidComponentID)
+    {
+        return Pair;
+    }
+    Pair = AcquirePairComponent(Relation, Target);
+    const uint32_t Index = GetEntityIndex(Target);
+    if (Index >= PairsByTarget.size())
+    {
+        PairsByTarget.resize(Index + 1);
+    }
+    PairsByTarget[Index].push_back(Pair);
+    return Pair;
+}
+
+void World::ReleasePair(ComponentID Pair)
+{
+    std::pmr::vector<ComponentID>& Pairs = PairsByTarget[GetEntityIndex(GetComponentInfo(Pair).Target)];
+    Pairs.erase(std::remove(Pairs.begin(), Pairs.end(), Pair), Pairs.end());
+    DeadPairs.erase(std::remove(DeadPairs.begin(), DeadPairs.end(), Pair), DeadPairs.end());
+    ReleasePairComponent(Pair);
+}
+
+size_t World::ReleaseDeadPairs()
+{
+    size_t Freed = 0;
+    std::vector<EntityID> Sources;
+    while (!DeadPairs.empty())
+    {
+        const ComponentID Pair = DeadPairs.back();
+        // Deltas may have placed entities under the pair after its target died
+        Sources.clear();
+        for (auto Arch : GetArchetypesWith(Pair))
+        {
+            for (size_t c = 0; c < Arch->GetChunkCount(); c++)
+            {
+                const ArchetypeChunk* Chunk = Arch->GetChunk(c);
+                Sources.insert(Sources.end(), Chunk->GetEntityIDs(), Chunk->GetEntityIDs() + Chunk->GetCount());
+            }
+        }
+        for (const auto Source : Sources)
+        {
+            Remove(Source, Pair);
+        }
+        if (GetArchetypesWith(Pair).empty())
+        {
+            ReleasePair(Pair);
+        }
+        // Dropping the last archetype with the pair releases it
+        while (!GetArchetypesWith(Pair).empty())
+        {
+            Freed += DropArchetype(ArchetypeLookup.at(*GetArchetypesWith(Pair).back()->GetSignature()));
+        }
+    }
+    return Freed;
+}
+
+EntityID World::GetTarget(EntityID Entity, ComponentID Relation) const
+{
+    const EntitySlot* Slot = FindSlot(Entity);
+    return Slot != nullptr ? Slot->Arch->GetTarget(Relation) : 0;
+}
+
+bool World::ChangePair(ArchSignature& Signature, ComponentID Type, bool Adding)
+{
+    const ComponentInfo& Info = GetComponentInfo(Type);
+    if (Signature.Contains(Type) == Adding)
+    {
+        return false;
+    }
+    const ComponentID Relation = Info.Relation != InvalidComponentID ? Info.Relation : Type;
+    const ArchSignature Before = Signature;
+    for (const auto Other : Before)
+    {
+        if (GetComponentInfo(Other).Relation == Relation)
+        {
+            Signature.Remove(Other);
+        }
+    }
+    if (Adding)
+    {
+        Signature.Add(Type);
+        Signature.Add(Relation);
+    }
+    else
+    {
+        Signature.Remove(Relation);
+    }
+    return true;
+}
+
+bool World::ChangePairNow(const EntityID& Entity, ComponentID Type, bool Adding)
+{
+    const EntitySlot& Slot = Slots[GetEntityIndex(Entity)];
+    const ComponentInfo& Info = GetComponentInfo(Type);
+    if (Info.Relation == InvalidComponentID && Slot.Arch->GetTarget(Type) == 0)
+    {
+        return false;
+    }
+    // A pair to a dead entity would never be cleaned up
+    if (Adding && Info.Relation != InvalidComponentID && !IsAlive(Info.Target))
+    {
+        return true;
+    }
+    ArchSignature Target = *Slot.Arch->GetSignature();
+    if (ChangePair(Target, Type, Adding))
+    {
+        MoveEntity(Entity, FindOrAddArchetype(&Target), InvalidComponentID, nullptr);
+    }
+    return true;
+}
+
+void World::CollectHierarchy(ComponentID Relation, const ArchSignature& Signature, std::vector<Archetype*>& Out)
+{
+    CollectMatches(Signature, ArchSignature(), Out);
+    // Depth of an archetype is one more than that of its target's archetype, roots are 0
+    std::unordered_map<const Archetype*, uint32_t> Depths;
+    std::vector<const Archetype*> Chain;
+    for (auto Arch : Out)
+    {
+        Chain.clear();
+        uint32_t Depth = 0;
+        for (const Archetype* At = Arch;;)
+        {
+            auto Found = Depths.find(At);
+            if (Found != Depths.end())
+            {
+                Depth = Found->second + 1;
+                break;
+            }
+            Chain.push_back(At);
+            if (Chain.size() > Archetypes.size())
+            {
+                Error("Relation %d forms a cycle\n", Relation);
+            }
+            const EntitySlot* Parent = FindSlot(At->GetTarget(Relation));
+            if (Parent == nullptr)
+            {
+                break;
+            }
+            At = Parent->Arch;
+        }
+        for (auto It = Chain.rbegin(); It != Chain.rend(); ++It)
+        {
+            Depths[*It] = Depth++;
+        }
+    }
+    std::stable_sort(Out.begin(), Out.end(), [&](const Archetype* A, const Archetype* B)
+    {
+        return Depths[A] < Depths[B];
+    });
+}
+
+const std::vector<Archetype*>& World::GetHierarchyOrder(ComponentID Relation, const ArchSignature& Signature)
+{
+    auto Found = std::find_if(HierarchyOrders.begin(), HierarchyOrders.end(), [&](const HierarchyOrder& Order)
+    {
+        return Order.Relation == Relation && Order.Signature == Signature;
+    });
+    if (Found == HierarchyOrders.end())
+    {
+        Found = HierarchyOrders.insert(Found, HierarchyOrder{Relation, Signature, 0, {}});
+    }
+    if (Found->Version != HierarchyVersion)
+    {
+        Found->Ordered.clear();
+        CollectHierarchy(Relation, Signature, Found->Ordered);
+        Found->Version = HierarchyVersion;
+    }
+    return Found->Ordered;
+}
+
+void World::TouchTarget(const EntityID& Entity)
+{
+    const uint32_t Index = GetEntityIndex(Entity);
+    if (Index < PairsByTarget.size() && !PairsByTarget[Index].empty())
+    {
+        HierarchyVersion++;
+    }
+}
+
+SparseSet* World::FindSparsePool(ComponentID Type) const
+{
+    return static_cast<size_t>(Type) < SparsePools.size() ? SparsePools[Type] : nullptr;
+}
+
+SparseSet* World::GetSparsePool(ComponentID Type)
+{
+    if (static_cast<size_t>(Type) >= SparsePools.size())
+    {
+        SparsePools.resize(Type + 1, nullptr);
+    }
+    if (SparsePools[Type] == nullptr)
+    {
+        SparsePools[Type] = Allocator.new_object<SparseSet>(GetComponentInfo(Type), Resource);
+        SparsePoolList.push_back(SparsePools[Type]);
+    }
+    return SparsePools[Type];
+}
+
+bool World::PassesSparseFilter(EntityID Entity, const SparseFilter& Filter) const
+{
+    for (const auto Type : Filter.Required)
+    {
+        const SparseSet* Pool = FindSparsePool(Type);
+        if (Pool == nullptr || !Pool->Contains(Entity))
+        {
+            return false;
+        }
+    }
+    for (const auto Type : Filter.Excluded)
+    {
+        const SparseSet* Pool = FindSparsePool(Type);
+        if (Pool != nullptr && Pool->Contains(Entity))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void World::TrimDeltaHistory(ChangeTick Before)
+{
+    // Deletes are logged in tick order
+    auto Kept = std::partition_point(DeletedLog.begin(), DeletedLog.end(),
+        [&](const auto& Entry) { return Entry.second <= Before; });
+    DeletedLog.erase(DeletedLog.begin(), Kept);
+}
+
+size_t World::Compact()
+{
+    if (WorldLock)
+    {
+        Error("Cannot compact while world is locked\n");
+    }
+    ECS_TRACE_SCOPE("Compact", Archetypes.size());
+    size_t Freed = ReleaseDeadPairs();
+    // The empty archetype every entity starts in is kept
+    for (size_t Index = 1; Index < Archetypes.size();)
+    {
+        if (Archetypes[Index]->GetEntityCount() == 0)
+        {
+            Freed += DropArchetype(Index);
+            continue;
+        }
+        Freed += Archetypes[Index]->ShrinkToFit();
+        Index++;
+    }
+    CompactCursor = 1;
+    // Pairs acquired for entities that never took them
+    for (auto& Pairs : PairsByTarget)
+    {
+        for (size_t i = Pairs.size(); i-- > 0;)
+        {
+            if (GetArchetypesWith(Pairs[i]).empty())
+            {
+                ReleasePair(Pairs[i]);
+            }
+        }
+    }
+
+    auto Trim = [&Freed](auto& List)
+    {
+        const size_t Before = List.capacity();
+        List.shrink_to_fit();
+        Freed += (Before - List.capacity()) * sizeof(List[0]);
+    };
+    // Indexed by ID, so only the empty tail can go
+    auto TrimTail = [&Trim](auto& Lists)
+    {
+        while (!Lists.empty() && Lists.back().empty())
+        {
+            Lists.pop_back();
+        }
+        for (auto& List : Lists)
+        {
+            Trim(List);
+        }
+        Trim(Lists);
+    };
+    TrimTail(ArchetypesByComponent);
+    TrimTail(PairsByTarget);
+    for (auto& List : QueriesByComponent)
+    {
+        Trim(List);
+    }
+    Trim(Archetypes);
+    Trim(FreeSlots);
+    Trim(DeletedLog);
+    // A stale order is redone on its next use, so it holds nothing worth keeping
+    for (auto& Order : HierarchyOrders)
+    {
+        if (Order.Version != HierarchyVersion)
+        {
+            Order.Ordered.clear();
+        }
+        Trim(Order.Ordered);
+    }
+    ArchetypeLookup.rehash(0);
+    for (auto Pool : SparsePoolList)
+    {
+        Freed += Pool->ShrinkToFit();
+    }
+    // Commands made outside of ticks may still sit in the main buffer
+    if (MainBuffer == nullptr)
+    {
+        for (auto Arena : CommandArenas)
+        {
+            Freed += Arena->Release();
+        }
+    }
+    ECS_TRACE_COUNTER("Bytes compacted", Freed);
+    return Freed;
+}
+
+size_t World::Compact(size_t Budget)
+{
+    if (WorldLock)
+    {
+        Error("Cannot compact while world is locked\n");
+    }
+    size_t Freed = ReleaseDeadPairs();
+    const size_t Visits = std::min(Budget, Archetypes.size() - 1);
+    for (size_t Visit = 0; Visit < Visits; Visit++)
+    {
+        if (CompactCursor >= Archetypes.size())
+        {
+            CompactCursor = 1;
+        }
+        Archetype* Arch = Archetypes[CompactCursor];
+        if (!Arch->MarkIdle())
+        {
+            CompactCursor++;
+        }
+        else if (Arch->GetEntityCount() == 0)
+        {
+            // The last archetype moves in under the cursor and is visited next
+            Freed += DropArchetype(CompactCursor);
+        }
+        else
+        {
+            Freed += Arch->ShrinkToFit();
+            CompactCursor++;
+        }
+    }
+    if (Freed > 0)
+    {
+        ECS_TRACE_COUNTER("Bytes compacted", Freed);
+    }
+    return Freed;
+}
+
+size_t World::DropArchetype(size_t Index)
+{
+    Archetype* Arch = Archetypes[Index];
+    const size_t Freed = Arch->GetAllocatedBytes();
+    Arch->Unlink();
+    for (const auto Type : *Arch->GetSignature())
+    {
+        std::pmr::vector<Archetype*>& With = ArchetypesByComponent[Type];
+        With.erase(std::find(With.begin(), With.end(), Arch));
+        // A pair nothing has any more goes back to the registry, it is acquired again on its next use
+        if (With.empty() && GetComponentInfo(Type).Relation != InvalidComponentID)
+        {
+            ReleasePair(Type);
+        }
+    }
+    for (auto Cached : Queries)
+    {
+        Cached->RemoveMatch(Arch);
+    }
+    ArchetypeLookup.erase(*Arch->GetSignature());
+    Archetypes[Index] = Archetypes.back();
+    Archetypes.pop_back();
+    if (Index < Archetypes.size())
+    {
+        ArchetypeLookup[*Archetypes[Index]->GetSignature()] = Index;
+    }
+    Allocator.delete_object(Arch);
+    HierarchyVersion++;
+    ECS_TRACE_COUNTER("Archetypes", Archetypes.size());
+    return Freed;
+}
+
+Archetype* World::FindOrAddArchetype(const ArchSignature* Signature)
+{
+    if (WorldLock)
+    {
+        Error("Cannot make new archetypes while world is locked");
+    }
+    auto Found = ArchetypeLookup.find(*Signature);
+    if (Found == ArchetypeLookup.end())
+    {
+        Archetype* NewArch = Allocator.new_object<Archetype>(*Signature, ChunkBytes, Resource);
+        ArchetypeLookup.emplace(*Signature, Archetypes.size());
+        Archetypes.emplace_back(NewArch);
+        HierarchyVersion++;
+        ECS_TRACE_COUNTER("Archetypes", Archetypes.size());
+        for (const auto Type : *Signature)
+        {
+            GetArchetypesWith(Type);
+            ArchetypesByComponent[Type].push_back(NewArch);
+        }
+        // Only queries watching one of its components can match it
+        for (const auto Type : *Signature)
+        {
+            if (static_cast<size_t>(Type) < QueriesByComponent.size())
+            {
+                for (auto Cached : QueriesByComponent[Type])
+                {
+                    Cached->TryAddMatch(NewArch);
+                }
+            }
+        }
+        for (auto Cached : UnindexedQueries)
+        {
+            Cached->TryAddMatch(NewArch);
+        }
+        return NewArch;
+    }
+    return Archetypes[Found->second];
+}
+
+void World::ChangeEntityType(const EntityID& Entity, ComponentID Type, const void* Data)
+{
+    EntitySlot& Slot = Slots[GetEntityIndex(Entity)];
+    Archetype* CurrentArchetype = Slot.Arch;
+
+    const bool Adding = Data != nullptr;
+    Archetype* NewArchetype = Adding ? CurrentArchetype->GetAddEdge(Type) : CurrentArchetype->GetRemoveEdge(Type);
+    if (NewArchetype == nullptr)
+    {
+        ArchSignature NewSig = *CurrentArchetype->GetSignature();
+        if(Adding)
+        {
+            NewSig.Add(Type);
+        }else
+        {
+            NewSig.Remove(Type);
+        }
+        NewArchetype = FindOrAddArchetype(&NewSig);
+        // The edge is walked in both directions, so record the way back as well
+        if (Adding)
+        {
+            CurrentArchetype->SetAddEdge(Type, NewArchetype);
+            NewArchetype->SetRemoveEdge(Type, CurrentArchetype);
+        }
+        else
+        {
+            CurrentArchetype->SetRemoveEdge(Type, NewArchetype);
+            NewArchetype->SetAddEdge(Type, CurrentArchetype);
+        }
+    }
+    // On removal nothing is added, the destination simply lacks the removed column
+    MoveEntity(Entity, NewArchetype, Adding ? Type : InvalidComponentID, Data);
+}
+
+void World::MoveEntity(const EntityID& Entity, Archetype* Target, ComponentID AddedType, const void* Data)
+{
+    EntitySlot& Slot = Slots[GetEntityIndex(Entity)];
+    Archetype* CurrentArchetype = Slot.Arch;
+    const ChangeTick Tick = GetWriteTick();
+    TouchTarget(Entity);
+    const size_t NewRow = Target->CopyEntity(Entity, CurrentArchetype, Slot.Row, AddedType, Data, Tick);
+    const EntityID Moved = CurrentArchetype->FastDelete(Slot.Row);
+    if (Moved != 0)
+    {
+        Slots[GetEntityIndex(Moved)].Row = Slot.Row;
+    }
+    Slot.Arch = Target;
+    Slot.Row = NewRow;
+    Slot.PlacedTick = Tick;
+}
+
+void World::Submit(SubmittedCommands* Commands)
+{
+    Commands->Next = Submitted.load(std::memory_order_relaxed);
+    while (!Submitted.compare_exchange_weak(Commands->Next, Commands, std::memory_order_release,
+        std::memory_order_relaxed))
+    {
+    }
+}
+
+void World::FlushSubmitted()
+{
+    if (WorldLock)
+    {
+        Error("Cannot flush submitted commands while world is locked\n");
+    }
+    SubmittedCommands* Newest = Submitted.exchange(nullptr, std::memory_order_acquire);
+    // Reversed into submission order
+    SubmittedCommands* Oldest = nullptr;
+    while (Newest != nullptr)
+    {
+        SubmittedCommands* Next = Newest->Next;
+        Newest->Next = Oldest;
+        Oldest = Newest;
+        Newest = Next;
+    }
+    while (Oldest != nullptr)
+    {
+        SubmittedCommands* Next = Oldest->Next;
+        FlushCommands(Oldest->Buffer);
+        for (const EntityID& Entity : Oldest->Released)
+        {
+            ReleaseReserved(Entity);
+        }
+        Allocator.delete_object(Oldest);
+        Oldest = Next;
+    }
+    ReleaseCommandBuffers();
+}
+
+void World::Tick()
+{
+    ECS_TRACE_SCOPE("Tick", Systems.size());
+    FlushSubmitted();
+    if (ScheduleDirty)
+    {
+        Schedule.Build(Systems);
+        ScheduleDirty = false;
+    }
+
+    std::vector<std::function<void()>> Jobs;
+    for (const auto& Stage : Schedule.GetStages())
+    {
+        WorldLock = true;
+        Jobs.clear();
+        for (size_t Index : Stage)
+        {
+            Jobs.emplace_back([this, Index]() { RunSystem(Index); });
+        }
+        Workers.Run(Jobs);
+        WorldLock = false;
+
+        for (size_t Index : Stage)
+        {
+            if (SystemBuffers[Index] != nullptr)
+            {
+                FlushCommands(*SystemBuffers[Index]);
+            }
+        }
+    }
+    FlushMainBuffer();
+    ReleaseCommandBuffers();
+    ReleaseDeadPairs();
+    if (CompactBudget > 0)
+    {
+        Compact(CompactBudget);
+    }
+}
+
+void World::FlushMainBuffer()
+{
+    if (MainBuffer != nullptr)
+    {
+        FlushCommands(*MainBuffer);
+    }
+}
+
+void World::RunSystem(size_t Index)
+{
+    System& System = Systems[Index];
+    ECS_TRACE_SCOPE("System", Index);
+    ECS_TRACE_COUNTER("Entities iterated", CountRows(*System.GetMatchedArchetypes()));
+    const ActiveContext Previous = Active;
+    Active = {this, &SystemBuffers[Index], ++CurrentTick, &System};
+    if (System.IsParallel())
+    {
+        RunChunked(*System.GetMatchedArchetypes(), System);
+        System.SetLastRunTick(Active.Tick);
+        Active = Previous;
+        return;
+    }
+    for (auto Archetype : *System.GetMatchedArchetypes())
+    {
+        if (System.IsRangeSystem())
+        {
+            for (size_t i = 0; i < Archetype->GetChunkCount(); i++)
+            {
+                ArchetypeChunk* Chunk = Archetype->GetChunk(i);
+                if (Chunk->GetCount() == 0 || !System.PassesChangeFilters(*Archetype, *Chunk))
+                {
+                    continue;
+                }
+                const size_t Begin = i * Archetype->GetRowsPerChunk();
+                System.GetRangeHandler()(this, Archetype, Begin, Begin + Chunk->GetCount());
+                MarkWritten(System.GetWrites(), *Archetype, *Chunk, Active.Tick);
+            }
+            continue;
+        }
+        if (System.IsArchetypeSystem())
+        {
+            System.GetArchetypeHandler()(this, Archetype);
+            continue;
+        }
+        for (int i = static_cast<int>(Archetype->GetEntityCount()) - 1; i >= 0; i--)
+        {
+            Entity E(this, Archetype->GetEntityID(i));
+            System.GetHandler()(this, E);
+        }
+    }
+    System.SetLastRunTick(Active.Tick);
+    Active = Previous;
+}
+
+void World::MarkWritten(const ArchSignature& Writes, const Archetype& Arch, ArchetypeChunk& Chunk, ChangeTick Tick)
+{
+    for (const auto Type : Writes)
+    {
+        // Optional components may be missing
+        const int Index = Arch.GetColumnIndex(Type);
+        if (Index >= 0)
+        {
+            Chunk.MarkChanged(Index, Tick);
+        }
+    }
+}
+
+void World::RunChunked(const std::vector<Archetype*>& Matches, const System& Sys)
+{
+    const ParallelSettings& Settings = Sys.GetParallelSettings();
+    const System::RowRangeHandler& Handler = Sys.GetRangeHandler();
+    const ChangeTick Tick = GetWriteTick();
+    struct RowRange
+    {
+        Archetype* Arch;
+        size_t Begin;
+        size_t End;
+    };
+    std::pmr::vector<RowRange> Chunks(GetCommandArena());
+    for (auto Arch : Matches)
+    {
+        // Jobs never straddle two storage chunks, a job only touches one block of memory
+        for (size_t i = 0; i < Arch->GetChunkCount(); i++)
+        {
+            ArchetypeChunk* Chunk = Arch->GetChunk(i);
+            if (Chunk->GetCount() == 0 || !Sys.PassesChangeFilters(*Arch, *Chunk))
+            {
+                continue;
+            }
+            const size_t ChunkBegin = i * Arch->GetRowsPerChunk();
+            const size_t ChunkEnd = ChunkBegin + Chunk->GetCount();
+            for (size_t Begin = ChunkBegin; Begin < ChunkEnd;)
+            {
+                const size_t End = std::min(Begin + Settings.ChunkSize, ChunkEnd);
+                Chunks.push_back({Arch, Begin, End});
+                Begin = End;
+            }
+            // Stamped up front on this thread, jobs sharing a chunk would otherwise race on it
+            MarkWritten(Sys.GetWrites(), *Arch, *Chunk, Tick);
+        }
+    }
+    if (Chunks.empty())
+    {
+        return;
+    }
+
+    const bool WasLocked = WorldLock;
+    if (!WasLocked)
+    {
+        WorldLock = true;
+    }
+
+    std::pmr::vector<CommandBuffer*> ChunkBuffers(Chunks.size(), nullptr, GetCommandArena());
+    std::atomic<size_t> NextChunk = 0;
+    // Chunks run on behalf of the system calling this, if any
+    const System* Running = Active.Owner == this ? Active.Running : nullptr;
+    auto Runner = [&]()
+    {
+        const ActiveContext Previous = Active;
+        for (size_t i = NextChunk++; i < Chunks.size(); i = NextChunk++)
+        {
+            Active = {this, &ChunkBuffers[i], Tick, Running};
+            ECS_TRACE_SCOPE("Chunk", Chunks[i].End - Chunks[i].Begin);
+            Handler(this, Chunks[i].Arch, Chunks[i].Begin, Chunks[i].End);
+        }
+        Active = Previous;
+    };
+    size_t Threads = Workers.GetThreadCount();
+    if (Settings.ThreadCount != 0)
+    {
+        Threads = std::min<size_t>(Threads, Settings.ThreadCount);
+    }
+    Threads = std::min(Threads, Chunks.size());
+    Workers.Run(std::vector<std::function<void()>>(Threads, Runner));
+
+    if (!WasLocked)
+    {
+        WorldLock = false;
+    }
+
+    // Chunk order rather than completion order, so replays stay reproducible
+    for (auto Buffer : ChunkBuffers)
+    {
+        if (Buffer == nullptr)
+        {
+            continue;
+        }
+        if (WasLocked)
+        {
+            GetCommandBuffer()->Append(*Buffer);
+        }
+        else
+        {
+            FlushCommands(*Buffer);
+        }
+        std::destroy_at(Buffer);
+    }
+}
+
+void World::FlushCommands(CommandBuffer& Buffer)
+{
+    ECS_TRACE_SCOPE("Flush commands", Buffer.GetCommandCount());
+    const std::pmr::vector<Command>& Commands = Buffer.GetCommands();
+    if (Commands.empty())
+    {
+        return;
+    }
+    // Everything applied by one flush shares a tick
+    const ActiveContext Previous = Active;
+    if (Active.Owner != this)
+    {
+        Active = {this};
+    }
+    Active.Tick = GetWriteTick();
+
+    // Commands are grouped per entity, keeping entities in the order they were first touched and each entity's
+    // commands in the order they were recorded
+    BumpArena* Arena = GetCommandArena();
+    std::pmr::unordered_map<EntityID, uint32_t> FirstTouch(Arena);
+    std::pmr::vector<std::pair<uint32_t, const Command*>> Sorted(Arena);
+    Sorted.reserve(Commands.size());
+    for (const Command& Cmd : Commands)
+    {
+        const auto Found = FirstTouch.try_emplace(Cmd.Entity, static_cast<uint32_t>(FirstTouch.size())).first;
+        Sorted.emplace_back(Found->second, &Cmd);
+    }
+    // Commands sit in one array, so their addresses keep ties in recording order without a stable sort
+    std::sort(Sorted.begin(), Sorted.end());
+
+    std::pmr::vector<const Command*> Group(Arena);
+    for (size_t Begin = 0; Begin < Sorted.size();)
+    {
+        Group.clear();
+        size_t End = Begin;
+        for (; End < Sorted.size() && Sorted[End].first == Sorted[Begin].first; End++)
+        {
+            Group.push_back(Sorted[End].second);
+        }
+        ApplyCommands(Group.data(), Group.size());
+        Begin = End;
+    }
+    Buffer.Clear();
+    Active = Previous;
+}
+
+void World::ApplyCommands(const Command* const* Commands, size_t Count)
+{
+    const EntityID Entity = Commands[0]->Entity;
+    bool Spawned = false;
+    bool Deleted = false;
+    // Net effect per component: the last Set still standing, or null when the last word was a Remove
+    std::pmr::vector<std::pair<ComponentID, const Command*>> Changes(GetCommandArena());
+    auto Change = [&](ComponentID Type, const Command* Value)
+    {
+        auto Found = std::find_if(Changes.begin(), Changes.end(),
+            [&](const auto& Known) { return Known.first == Type; });
+        if (Found == Changes.end())
+        {
+            Changes.emplace_back(Type, Value);
+        }
+        else
+        {
+            Found->second = Value;
+        }
+    };
+    for (size_t i = 0; i < Count && !Deleted; i++)
+    {
+        const Command& Cmd = *Commands[i];
+        switch (Cmd.Op)
+        {
+        case CommandType::Spawn:
+            Spawned = true;
+            break;
+        case CommandType::Delete:
+            Deleted = true;
+            break;
+        case CommandType::Set:
+        case CommandType::Remove:
+            Change(Cmd.Type, Cmd.Op == CommandType::Set ? &Cmd : nullptr);
+            break;
+        case CommandType::AddPair:
+            {
+                EntityID Target;
+                memcpy(&Target, Cmd.Value, sizeof(Target));
+                if (IsAlive(Target))
+                {
+                    Change(GetPair(Cmd.Type, Target), &Cmd);
+                }
+            }
+            break;
+        }
+    }
+
+    if (Spawned)
+    {
+        AddEntity(Entity);
+    }
+    const EntitySlot* Slot = FindSlot(Entity);
+    if (Slot == nullptr)
+    {
+        return;
+    }
+    if (Deleted)
+    {
+        Delete(Entity);
+        return;
+    }
+
+    ArchSignature Target = *Slot->Arch->GetSignature();
+    size_t Moves = 0;
+    const std::pair<ComponentID, const Command*>* Single = nullptr;
+    bool HasPairs = !Slot->Arch->GetPairs().empty();
+    for (const auto& Change : Changes)
+    {
+        const ComponentInfo& Info = GetComponentInfo(Change.first);
+        if (Info.Relation != InvalidComponentID || (HasPairs && Info.Tag))
+        {
+            // Pairs move along with their relation, so this always takes a full move
+            const bool Adding = Change.second != nullptr;
+            if ((!Adding || Info.Relation == InvalidComponentID || IsAlive(Info.Target))
+                && ChangePair(Target, Change.first, Adding))
+            {
+                HasPairs = true;
+                Moves += 2;
+            }
+            continue;
+        }
+        if (Info.Sparse || Target.Contains(Change.first) == (Change.second != nullptr))
+        {
+            continue;
+        }
+        if (Change.second != nullptr)
+        {
+            Target.Add(Change.first);
+        }
+        else
+        {
+            Target.Remove(Change.first);
+        }
+        Single = &Change;
+        Moves++;
+    }
+
+    if (Moves == 1)
+    {
+        // A single add or remove walks the cached archetype edge
+        ChangeEntityType(Entity, Single->first, Single->second != nullptr ? Single->second->Value : nullptr);
+    }
+    else if (Moves > 1)
+    {
+        MoveEntity(Entity, FindOrAddArchetype(&Target), InvalidComponentID, nullptr);
+    }
+
+    for (const auto& Change : Changes)
+    {
+        if (GetComponentInfo(Change.first).Sparse)
+        {
+            if (Change.second != nullptr)
+            {
+                GetSparsePool(Change.first)->Set(Entity, Change.second->Value);
+            }
+            else if (SparseSet* Pool = FindSparsePool(Change.first))
+            {
+                Pool->Remove(Entity);
+            }
+        }
+        else if (Change.second != nullptr && !GetComponentInfo(Change.first).Tag)
+        {
+            Slot->Arch->SetValue(Slot->Row, Change.first, Change.second->Value, Active.Tick);
+        }
+    }
+}
+
+void World::AddSystem(System System)
+{
+    System.SetQuery(AddQuery(System.GetSignature(), ArchSignature(), System.GetExclusions()));
     Systems.emplace_back(System);
+    SystemBuffers.emplace_back(nullptr);
+    ScheduleDirty = true;
 }
@@ -1,35 +1,98 @@
 ﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <functional>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "Types.h"
 #include "Archetype.h"
+#include "BumpArena.h"
+#include "ChangeFilters.h"
+#include "Column.h"
 #include "Component.h"
 #include "ErrorHandling.h"
+#include "FieldSpans.h"
+#include "Query.h"
+#include "QueryTerms.h"
+#include "Scheduler.h"
+#include "SparseSet.h"
 #include "System.h"
+#include "ThreadPool.h"
 
+class CommandBatch;
 class Entity;
 
-class SetQueue
+enum class CommandType : uint8_t
+{
+    Spawn,
+    Set,
+    Remove,
+    Delete,
+    // Type is the relation and Value the target, the pair is only looked up once the command is applied
+    AddPair
+};
+
+// One structural change. Set values live in the arena of the buffer that recorded them
+struct Command
+{
+    EntityID Entity;
+    ComponentID Type;
+    CommandType Op;
+    void* Value;
+};
+
+// Structural changes made while the world is locked, recorded in the order they were made. Every system gets its
+// own buffer so systems running at the same time never share one, and buffers are flushed in system registration
+// order to keep results deterministic. Buffers live in a per thread arena of the world and are thrown away at the
+// end of every tick
+class CommandBuffer
 {
 public:
-    SetQueue(IStorage* Storage);
+    explicit CommandBuffer(std::pmr::memory_resource* Resource);
 
-    ~SetQueue();
-    SetQueue(const SetQueue& obj) = delete;
+    ~CommandBuffer();
+    CommandBuffer(const CommandBuffer& obj) = delete;
 
-    void Enqueue(EntityID Entity, const void* Data) const;
+    void Spawn(EntityID Entity);
+    void Set(EntityID Entity, ComponentID Type, const void* Data);
+    void Remove(EntityID Entity, ComponentID Type);
+    void Delete(EntityID Entity);
+    void AddPair(EntityID Entity, ComponentID Relation, EntityID Target);
 
-    void ForEach(std::function<void(EntityID&, void*)> Handler);
+    // Moves everything recorded in Other behind what is already recorded here. Values stay where Other put them,
+    // so Other's arena must outlive this buffer
+    void Append(CommandBuffer& Other);
 
-    void Empty()
-    {
-        EntityIDs->Empty();
-        ComponentBuffer->Empty();
-    }
+    size_t GetCommandCount() const { return Commands.size(); }
+    const std::pmr::vector<Command>& GetCommands() const { return Commands; }
+
+    // Destroys the recorded values. Their memory is handed back when the arena is reset
+    void Clear();
 
 private:
-    VectorStorage<EntityID>* EntityIDs;
-    IStorage* ComponentBuffer;
+    std::pmr::polymorphic_allocator<> Allocator;
+    std::pmr::vector<Command> Commands;
+};
+
+struct WorldConfig
+{
+    // Threads used to run non conflicting systems in parallel, including the thread calling Tick. 0 uses all cores
+    unsigned ThreadCount = 1;
+    // Size of the blocks archetypes store their rows in. Blocks never move, so growing an archetype copies
+    // nothing and jobs map onto whole blocks. 0 keeps one contiguous buffer per column, 16 KiB is a good size
+    size_t ChunkBytes = 0;
+    // Where all memory of the world comes from, the default resource when null. Worlds with more than one thread
+    // or fed through CommandBatch call it from several threads at once, so it must then be thread safe
+    std::pmr::memory_resource* Resource = nullptr;
+    // Log deleted entities so WriteDelta can report them. The log grows until TrimDeltaHistory is called
+    bool TrackDeltas = false;
+    // Archetypes Tick visits with Compact(CompactBudget) once its systems are done. 0 leaves compaction to the caller
+    size_t CompactBudget = 0;
 };
 
 class World
@@ -37,12 +100,17 @@ class World
     
 public:
     World();
+    explicit World(const WorldConfig& Config);
 
     ~World();
     World(const World& obj) = delete;
 
     Entity NewEntity();
 
+    // False once the entity has been deleted, even if its slot has been reused since.
+    // Set, Remove and Delete on a dead entity are ignored and Get returns null
+    bool IsAlive(const EntityID& Entity) const;
+
     template<typename T>
     void Set(const EntityID& Entity, const T Data)
     {
@@ -54,6 +122,7 @@ public:
     template<typename T>
     T* Get(const EntityID& Entity)
     {
+        static_assert(!IsSplitComponent<T>, "Components split into fields have no address, use a span system");
         ComponentID Type = GetComponent<T>();
         void* R = Get(Entity, Type);
         return static_cast<T*>(R);
@@ -67,26 +136,640 @@ public:
     }
     void Remove(const EntityID& Entity, ComponentID Type);
     
+    // Deleting an entity deletes the sources of every cascading relation pointing at it, see AddPair
     void Delete(const EntityID& Entity);
 
+    // Points Entity at Target through the relation R, an empty component such as ChildOf. The pair (R, Target) and
+    // R itself join the entity's archetype, so systems can match With<R> and sources of one target share their
+    // archetype. An entity has at most one target per relation, adding another replaces it, and removing R
+    // removes the pair. When Target is deleted the sources lose the pair, or are deleted too when R cascades.
+    // Pair component IDs belong to this world and are recycled once their target is gone, at the end of the next
+    // Tick or Compact
+    template<typename R>
+    void AddPair(EntityID Entity, EntityID Target)
+    {
+        AddPair(Entity, GetComponent<R>(), Target);
+    }
+    void AddPair(EntityID Entity, ComponentID Relation, EntityID Target);
+
+    template<typename R>
+    void RemovePair(EntityID Entity)
+    {
+        Remove(Entity, GetComponent<R>());
+    }
+
+    // 0 when Entity has no pair of the relation
+    template<typename R>
+    EntityID GetTarget(EntityID Entity) const
+    {
+        return GetTarget(Entity, GetComponent<R>());
+    }
+    EntityID GetTarget(EntityID Entity, ComponentID Relation) const;
+
+    // Creates Count entities directly in the archetype made of Ts, skipping every intermediate archetype.
+    // Components start value initialized and Initializer is then run over the new rows, taking any of the
+    // handler forms AddSystem takes. Structural changes made by the initializer are applied once it is done
+    template<typename... Ts, typename Func>
+    void Spawn(size_t Count, Func Initializer)
+    {
+        static_assert(!(IsSparseComponent<Ts> || ...), "Sparse components live outside archetypes, Set them");
+        Archetype* Arch = SpawnRows(ArchSignature{GetComponent<Ts>()...}, Count);
+        const size_t FirstRow = Arch->GetEntityCount() - Count;
+        WorldLock = true;
+        Arch->ForEachChunk(FirstRow, FirstRow + Count, [&](ArchetypeChunk& Chunk, size_t Begin, size_t End)
+        {
+            RunChunk<Ts...>(Initializer, this, Arch, Chunk, Begin, End);
+        });
+        WorldLock = false;
+        FlushMainBuffer();
+        ReleaseCommandBuffers();
+    }
+
+    // Prefab form of Spawn, every new entity gets a copy of the given components
+    template<typename... Ts>
+    void SpawnPrefab(size_t Count, const Ts&... Prefab)
+    {
+        Spawn<Ts...>(Count, [&](ColumnSpan<Ts>... Columns)
+        {
+            (FillColumn(Columns, Prefab), ...);
+        });
+    }
+
+    // Writes every entity and component to Path, column by column. Components that are not trivially copyable need
+    // snapshot hooks, see SetSnapshotHooks. False if the file could not be written
+    bool SaveSnapshot(const char* Path) const;
+    // Restores a snapshot into this world, which must never have had entities. Columns are copied in bulk out of
+    // the mapped file and entity IDs stay what they were. Components are only looked up while the file is checked,
+    // so one naming a component this build never registered is refused, and pair IDs are taken once it is accepted.
+    // False, with the world left empty, for a missing or mismatched file
+    bool LoadSnapshot(const char* Path);
+
+    // Appends to Out everything that changed after tick Since: deleted entities, entities that were created or
+    // changed archetype with all their components, and the rows of every chunk column written since. Change
+    // tracking works per chunk, so a written chunk column is sent whole. Returns the tick to pass as Since next
+    // time. Reporting deletes needs WorldConfig::TrackDeltas. Sparse components are not tracked and only travel in
+    // full snapshots
+    ChangeTick WriteDelta(ChangeTick Since, std::vector<uint8_t>& Out) const;
+    // Replays a delta written by another world. Entities keep the IDs they have in the source, so a world mirroring
+    // another should not make entities of its own. False for a malformed delta, which may be partly applied
+    bool ApplyDelta(const uint8_t* Data, size_t Bytes);
+    // Forgets deletes up to and including tick Before, once no delta will be asked for from that far back
+    void TrimDeltaHistory(ChangeTick Before);
+    ChangeTick GetCurrentTick() const { return CurrentTick; }
+
+    // Gives back memory kept from a past peak: destroys empty archetypes, removing them from every query and system,
+    // and trims columns, sparse pools, command arenas and the world's indexes to what is in use. Returns the bytes
+    // freed. Pair IDs whose target is gone, or that no entity holds any more, go back to the registry. Entity slots
+    // are kept since they hold the generations of deleted IDs. Not allowed while systems run
+    size_t Compact();
+    // Incremental form visiting at most Budget archetypes, resuming where the last call stopped. It only touches
+    // archetypes no row was added to since its previous visit, so ones entities pass through every tick are kept
+    size_t Compact(size_t Budget);
+
+    // Cached query, matched against the archetypes that exist now and then against every new archetype having one
+    // of the components it is indexed under. Owned by the world, valid until RemoveQuery
+    Query* AddQuery(const ArchSignature& All, const ArchSignature& Any = ArchSignature(),
+        const ArchSignature& None = ArchSignature());
+    template<typename... Ts>
+    Query* AddQuery()
+    {
+        return AddQuery(ArchSignature{GetComponent<Ts>()...});
+    }
+    void RemoveQuery(Query* Cached);
+
+    // Runs Handler over the rows of every archetype Cached matches, taking any of the handler forms AddSystem
+    // takes. Ts are plain or Optional terms and every plain one must be in the query's All set, the query does the
+    // filtering. Structural changes are applied once it is done
+    template<typename... Ts, typename Func>
+    void ForEach(const Query& Cached, Func Handler)
+    {
+        static_assert(((IsDataTerm<Ts> && !IsChangeFilter<Ts>) && ...), "Query filters belong in the query");
+        if (WorldLock)
+        {
+            Error("Cannot run a query while world is locked\n");
+        }
+        ArchSignature Required;
+        ArchSignature Excluded;
+        ArchSignature Reads;
+        ArchSignature Writes;
+        SparseFilter Sparse;
+        (AddTerm<Ts>(Required, Excluded, Sparse, Reads, Writes), ...);
+        if (!Cached.GetAll().ContainsAll(Required))
+        {
+            Error("Query does not guarantee every component asked for\n");
+        }
+        RunTerms<Ts...>(Cached.GetMatchedArchetypes(), Handler, Writes, Sparse);
+    }
+
+    // Same as ForEach over every entity having Ts, visited in hierarchy order of the relation R: an entity always
+    // comes after its target, so parents are done before their children and a transform pass can read the
+    // parent's result. Sources of one target share an archetype, each archetype is still one contiguous pass.
+    // The archetype order is worked out on first use and kept until an archetype is made or dropped or a pair
+    // target changes archetype
+    template<typename R, typename... Ts, typename Func>
+    void ForEachInHierarchy(Func Handler)
+    {
+        static_assert(((IsDataTerm<Ts> && !IsChangeFilter<Ts>) && ...), "Hierarchy passes take no filters");
+        if (WorldLock)
+        {
+            Error("Cannot run a query while world is locked\n");
+        }
+        ArchSignature Required;
+        ArchSignature Excluded;
+        ArchSignature Reads;
+        ArchSignature Writes;
+        SparseFilter Sparse;
+        (AddTerm<Ts>(Required, Excluded, Sparse, Reads, Writes), ...);
+        RunTerms<Ts...>(GetHierarchyOrder(GetComponent<R>(), Required), Handler, Writes, Sparse);
+    }
+
+    // Applies everything submitted through CommandBatch so far, batch by batch in the order they were submitted.
+    // Tick does this before running any system
+    void FlushSubmitted();
+
 private:
+    friend class CommandBatch;
+
+    // What one CommandBatch::Submit hands over, in memory of its own so the producer never touches the world's
+    struct SubmittedCommands
+    {
+        explicit SubmittedCommands(std::pmr::memory_resource* Upstream):
+            Arena(Upstream), Buffer(&Arena), Released(&Arena) {}
+
+        SubmittedCommands* Next = nullptr;
+        BumpArena Arena;
+        CommandBuffer Buffer;
+        // Reserved entities that will never be spawned, their slots are freed once the buffer is applied
+        std::pmr::vector<EntityID> Released;
+    };
+    // Safe from any thread, the entity is only created once a Spawn command for it is applied
+    EntityID ReserveEntity();
+    // Frees the slot of a reserved entity that was never spawned
+    void ReleaseReserved(const EntityID& Entity);
+    // Lock free, safe from any thread
+    void Submit(SubmittedCommands* Commands);
+
+    Archetype* SpawnRows(const ArchSignature& Signature, size_t Count);
     Archetype* FindOrAddArchetype(const ArchSignature* Signature);
-    Archetype* ChangeEntityType(const EntityID& Entity, ComponentID Type, const void* Data);
+    // Archetypes having Type, in the order they were made
+    const std::pmr::vector<Archetype*>& GetArchetypesWith(ComponentID Type);
+    void ChangeEntityType(const EntityID& Entity, ComponentID Type, const void* Data);
+    // Moves a live entity into Target. Columns Target has and the current archetype lacks are value initialized,
+    // apart from AddedType which is copied from Data
+    void MoveEntity(const EntityID& Entity, Archetype* Target, ComponentID AddedType, const void* Data);
+    EntityID AllocateEntity();
+    void AddEntity(const EntityID& Entity);
+    // Makes sure Entity lives in Target under exactly this ID, creating it in its slot if needed
+    void PlaceEntity(const EntityID& Entity, Archetype* Target);
+    CommandBuffer* GetCommandBuffer();
+    // Archetypes any archetype matching Signature is among: those with its rarest component, or all of them
+    const std::pmr::vector<Archetype*>& GetCandidates(const ArchSignature& Signature);
+    void CollectMatches(const ArchSignature& Signature, const ArchSignature& Excluded, std::vector<Archetype*>& Out);
+    // Archetypes having Signature, ordered so the archetype of every pair target of Relation comes first
+    void CollectHierarchy(ComponentID Relation, const ArchSignature& Signature, std::vector<Archetype*>& Out);
+    // CollectHierarchy kept from earlier passes, redone once HierarchyVersion has moved on
+    const std::vector<Archetype*>& GetHierarchyOrder(ComponentID Relation, const ArchSignature& Signature);
+    // Moves the hierarchy order on if Entity is the target of any pair of this world
+    void TouchTarget(const EntityID& Entity);
+    // Adds or removes Type in Signature, keeping relationship pairs whole: a pair brings its relation along and
+    // replaces any other pair of it, and removing either drops both. False when nothing changed
+    static bool ChangePair(ArchSignature& Signature, ComponentID Type, bool Adding);
+    // Handles Set and Remove of a pair or of a relation having one. False when Type is neither
+    bool ChangePairNow(const EntityID& Entity, ComponentID Type, bool Adding);
+    void DeleteSources(const EntityID& Target);
+    // Pair of this world standing for (Relation, Target), InvalidComponentID when there is none yet
+    ComponentID FindPair(ComponentID Relation, EntityID Target) const;
+    ComponentID GetPair(ComponentID Relation, EntityID Target);
+    // Hands a pair no archetype has any more back to the registry
+    void ReleasePair(ComponentID Pair);
+    // Drops the archetypes of pairs whose target was deleted and releases the pairs. Returns the bytes freed
+    size_t ReleaseDeadPairs();
+    // Destroys the empty archetype at Index, the last archetype takes its place. Returns the bytes freed
+    size_t DropArchetype(size_t Index);
 
 public:
     void Tick();
     void AddSystem(System System);
 
+    // Typed system. Columns for Ts are resolved once per matched archetype and the handler is run over them
+    // in a flat loop. Handler may take (Ts&...) or (World*, EntityID, Ts&...) per row, or once per run of
+    // contiguous rows (ColumnSpan<Ts>...) or (World*, std::span<const EntityID>, ColumnSpan<Ts>...) so the
+    // loop inside can vectorize. Split components are only reachable through the span forms
+    // Components listed as const are only read, which lets the scheduler run the system next to other readers.
+    // Wrapping a component in Changed or Added skips chunks where it did not change since the last run
+    // With, Without and Optional terms change which archetypes are matched, see QueryTerms.h
+    // The scheduler only knows the components in Ts, so the handler must not Get any other component: a system
+    // writing it may be running at the same time. Debug builds report such a Get through Error. Set, Remove and
+    // other structural changes are always safe since they are deferred until the system's stage is done
+    template<typename... Ts, typename Func>
+    void AddSystem(Func Handler)
+    {
+        AddSystem(MakeSystem<Ts...>(Handler));
+    }
+
+    // Same as above but the rows of all matched archetypes are split into chunks spread over the worker pool.
+    // The handler is called from several threads at once
+    template<typename... Ts, typename Func>
+    void AddSystem(Func Handler, const ParallelSettings& Settings)
+    {
+        System Sys = MakeSystem<Ts...>(Handler);
+        Sys.SetParallel(Settings);
+        AddSystem(Sys);
+    }
+
+    // Runs Handler over every entity having Ts, split into chunks across the worker pool. Structural changes
+    // are deferred per chunk and applied in chunk order once every chunk is done, or handed to the calling
+    // system's buffer when used from inside Tick
+    template<typename... Ts, typename Func>
+    void ParallelForEach(Func Handler, const ParallelSettings& Settings = ParallelSettings())
+    {
+        static_assert(!(IsChangeFilter<Ts> || ...), "Change filters need a system that remembers its last run");
+        System Pass = MakeSystem<Ts...>(Handler);
+        Pass.SetParallel(Settings);
+        std::vector<Archetype*> Matches;
+        CollectMatches(Pass.GetSignature(), Pass.GetExclusions(), Matches);
+        RunChunked(Matches, Pass);
+        if (!WorldLock)
+        {
+            ReleaseCommandBuffers();
+        }
+    }
+
 private:
+    void RunSystem(size_t Index);
+    // Runs a range system over the chunks of Matches that pass its change filters, spread over the worker pool
+    void RunChunked(const std::vector<Archetype*>& Matches, const System& Sys);
+    // Stamps the columns of Writes that Chunk has, whether or not the handler actually changed them
+    static void MarkWritten(const ArchSignature& Writes, const Archetype& Arch, ArchetypeChunk& Chunk,
+        ChangeTick Tick);
+    // Tick of the system running on this thread, or a fresh one outside of systems
+    ChangeTick GetWriteTick();
+    void FlushCommands(CommandBuffer& Buffer);
+    // Applies the commands of one entity, given in the order they were recorded, with at most one archetype move
+    void ApplyCommands(const Command* const* Commands, size_t Count);
+    void FlushMainBuffer();
+    // Arena of the calling thread, reset at the end of every tick
+    BumpArena* GetCommandArena();
+    CommandBuffer* NewCommandBuffer();
+    // Only valid once every buffer has been flushed
+    void ReleaseCommandBuffers();
+
+    // Sparse components terms filter on, checked row by row since archetypes know nothing of them
+    struct SparseFilter
+    {
+        ArchSignature Required;
+        ArchSignature Excluded;
+
+        bool IsEmpty() const { return Required.IsEmpty() && Excluded.IsEmpty(); }
+    };
+    bool PassesSparseFilter(EntityID Entity, const SparseFilter& Filter) const;
+    // Null while nothing ever had the component
+    SparseSet* FindSparsePool(ComponentID Type) const;
+    SparseSet* GetSparsePool(ComponentID Type);
+
+    // Runs Handler over every row of Matches in order, with the world locked, then applies what it deferred
+    template<typename... Ts, typename Func>
+    void RunTerms(const std::vector<Archetype*>& Matches, const Func& Handler, const ArchSignature& Writes,
+        const SparseFilter& Sparse)
+    {
+        const ChangeTick Tick = GetWriteTick();
+        WorldLock = true;
+        for (auto Arch : Matches)
+        {
+            Arch->ForEachChunk(0, Arch->GetEntityCount(), [&](ArchetypeChunk& Chunk, size_t Begin, size_t End)
+            {
+                RunChunk<Ts...>(Handler, this, Arch, Chunk, Begin, End, Sparse.IsEmpty() ? nullptr : &Sparse);
+                MarkWritten(Writes, *Arch, Chunk, Tick);
+            });
+        }
+        WorldLock = false;
+        FlushMainBuffer();
+        ReleaseCommandBuffers();
+    }
+
+    template<typename... Ts, typename Func>
+    static System MakeSystem(Func Handler)
+    {
+        static_assert(!((IsChangeFilter<Ts> && IsMatchTerm<Unfiltered<Ts>>) || ...),
+            "Change filters only wrap plain components");
+        static_assert(!((IsChangeFilter<Ts> && IsSparseComponent<TermComponent<Ts>>) || ...),
+            "Changes of sparse components are not tracked");
+        static_assert(!((IsChangeFilter<Ts> && IsTagComponent<TermComponent<Ts>>) || ...),
+            "Tags have no column to track changes in");
+        static_assert(!((IsSparseComponent<TermComponent<Ts>> || ...) && TakesSpans<Func>(DataTerms<Ts...>())),
+            "Systems with sparse components need a row handler");
+        ArchSignature Required;
+        ArchSignature Excluded;
+        ArchSignature Reads;
+        ArchSignature Writes;
+        ArchSignature ChangedFilter;
+        ArchSignature AddedFilter;
+        SparseFilter Sparse;
+        (AddTerm<Ts>(Required, Excluded, Sparse, Reads, Writes), ...);
+        ((FilterTerm<Ts>::IsChanged ? ChangedFilter.Add(GetTermComponent<Ts>()) : void()), ...);
+        ((FilterTerm<Ts>::IsAdded ? AddedFilter.Add(GetTermComponent<Ts>()) : void()), ...);
+        System Sys(
+            Required,
+            Reads,
+            Writes,
+            MakeRangeHandler(Handler, DataTerms<Ts...>(), Sparse));
+        Sys.SetExclusions(Excluded);
+        Sys.SetChangeFilters(ChangedFilter, AddedFilter);
+        return Sys;
+    }
+
+    template<typename T>
+    static void AddTerm(ArchSignature& Required, ArchSignature& Excluded, SparseFilter& Sparse, ArchSignature& Reads,
+        ArchSignature& Writes)
+    {
+        using Match = MatchTerm<Unfiltered<T>>;
+        const ComponentID Type = GetTermComponent<T>();
+        constexpr bool IsSparse = IsSparseComponent<TermComponent<T>>;
+        if constexpr (Match::IsWithout)
+        {
+            (IsSparse ? Sparse.Excluded : Excluded).Add(Type);
+            return;
+        }
+        if constexpr (!Match::IsOptional)
+        {
+            (IsSparse ? Sparse.Required : Required).Add(Type);
+        }
+        if constexpr (!Match::IsWith)
+        {
+            (std::is_const_v<typename Match::Type> ? Reads : Writes).Add(Type);
+        }
+    }
+
+    template<typename Func, typename... Ts>
+    static constexpr bool TakesSpans(TermList<Ts...>)
+    {
+        return std::is_invocable_v<const Func&, World*, std::span<const EntityID>, typename TermAccess<Ts>::Span...>
+            || std::is_invocable_v<const Func&, typename TermAccess<Ts>::Span...>;
+    }
+
+    template<typename T>
+    static ComponentID GetTermComponent()
+    {
+        return GetComponent<TermComponent<T>>();
+    }
+
+    template<typename... Ts, typename Func>
+    static System::RowRangeHandler MakeRangeHandler(Func Handler, TermList<Ts...>, const SparseFilter& Sparse)
+    {
+        return [Handler, Sparse](World* Wrld, Archetype* Arch, size_t Begin, size_t End)
+        {
+            const SparseFilter* Filter = Sparse.IsEmpty() ? nullptr : &Sparse;
+            Arch->ForEachChunk(Begin, End, [&](ArchetypeChunk& Chunk, size_t LocalBegin, size_t LocalEnd)
+            {
+                RunChunk<Ts...>(Handler, Wrld, Arch, Chunk, LocalBegin, LocalEnd, Filter);
+            });
+        };
+    }
+
+    // Hands rows [Begin, End) of one chunk to Handler, as spans when it takes them and row by row otherwise.
+    // Rows failing Filter are skipped, which only row handlers allow
+    template<typename... Ts, typename Func>
+    static void RunChunk(const Func& Handler, World* Wrld, Archetype* Arch, ArchetypeChunk& Chunk,
+        size_t Begin, size_t End, const SparseFilter* Filter = nullptr)
+    {
+        const std::span<const EntityID> IDs(Chunk.GetEntityIDs() + Begin, End - Begin);
+        if constexpr (std::is_invocable_v<const Func&, World*, std::span<const EntityID>,
+            typename TermAccess<Ts>::Span...>)
+        {
+            static_assert(!(IsSparseComponent<TermComponent<Ts>> || ...), "Sparse components need a row handler");
+            Handler(Wrld, IDs, GetColumnSpan<Ts>(Arch, Chunk, Begin, End)...);
+        }
+        else if constexpr (std::is_invocable_v<const Func&, typename TermAccess<Ts>::Span...>)
+        {
+            static_assert(!(IsSparseComponent<TermComponent<Ts>> || ...), "Sparse components need a row handler");
+            Handler(GetColumnSpan<Ts>(Arch, Chunk, Begin, End)...);
+        }
+        else
+        {
+            static_assert(!(IsSplitComponent<Ts> || ...), "Components split into fields need a span handler");
+            RunColumns(Handler, Wrld, IDs.data(), IDs.size(), Filter, GetRowColumn<Ts>(Wrld, Arch, Chunk, Begin)...);
+        }
+    }
+
+    // Sparse components are looked up per row in their pool
+    template<typename T, bool IsOptional>
+    struct SparseColumn
+    {
+        SparseSet* Pool;
+    };
+
+    // Tags have no column, every row gets the same instance
+    template<typename T, bool IsOptional>
+    struct TagColumn
+    {
+        bool Present;
+    };
+
+    template<typename T>
+    static T& GetTagInstance()
+    {
+        static std::remove_const_t<T> Instance;
+        return Instance;
+    }
+
+    // Start of the rows in the column of T, wrapped in an OptionalColumn for optional terms
+    template<typename T>
+    static auto GetRowColumn(World* Wrld, Archetype* Arch, ArchetypeChunk& Chunk, size_t Begin)
+    {
+        if constexpr (IsSparseComponent<TermComponent<T>>)
+        {
+            return SparseColumn<typename MatchTerm<T>::Type, MatchTerm<T>::IsOptional>{
+                Wrld->FindSparsePool(GetTermComponent<T>())};
+        }
+        else if constexpr (IsTagComponent<TermComponent<T>>)
+        {
+            return TagColumn<typename MatchTerm<T>::Type, MatchTerm<T>::IsOptional>{
+                Arch->GetSignature()->Contains(GetTermComponent<T>())};
+        }
+        else if constexpr (MatchTerm<T>::IsOptional)
+        {
+            typename MatchTerm<T>::Type* Data = Arch->GetColumnData<TermComponent<T>>(Chunk);
+            return OptionalColumn<typename MatchTerm<T>::Type>{Data != nullptr ? Data + Begin : nullptr};
+        }
+        else
+        {
+            return static_cast<T*>(Arch->GetColumnData<std::remove_const_t<T>>(Chunk) + Begin);
+        }
+    }
+
+    template<typename T>
+    static T& GetRow(T* Column, const EntityID*, size_t Row)
+    {
+        return Column[Row];
+    }
+
+    template<typename T>
+    static T* GetRow(OptionalColumn<T> Column, const EntityID*, size_t Row)
+    {
+        return Column.Data != nullptr ? Column.Data + Row : nullptr;
+    }
+
+    // Rows reaching the handler passed the filter, so a required sparse value is there
+    template<typename T>
+    static T& GetRow(SparseColumn<T, false> Column, const EntityID* IDs, size_t Row)
+    {
+        return *static_cast<T*>(Column.Pool->Get(IDs[Row]));
+    }
+
+    template<typename T>
+    static T* GetRow(SparseColumn<T, true> Column, const EntityID* IDs, size_t Row)
+    {
+        return Column.Pool != nullptr ? static_cast<T*>(Column.Pool->Get(IDs[Row])) : nullptr;
+    }
+
+    template<typename T>
+    static T& GetRow(TagColumn<T, false>, const EntityID*, size_t)
+    {
+        return GetTagInstance<T>();
+    }
+
+    template<typename T>
+    static T* GetRow(TagColumn<T, true> Column, const EntityID*, size_t)
+    {
+        return Column.Present ? &GetTagInstance<T>() : nullptr;
+    }
+
+    template<typename T>
+    static typename TermAccess<T>::Span GetColumnSpan(Archetype* Arch, ArchetypeChunk& Chunk, size_t Begin,
+        size_t End)
+    {
+        if constexpr (IsTagComponent<TermComponent<T>>)
+        {
+            return typename TermAccess<T>::Span();
+        }
+        else if constexpr (MatchTerm<T>::IsOptional)
+        {
+            auto Data = Arch->GetColumnData<TermComponent<T>>(Chunk);
+            return Data != nullptr ? typename TermAccess<T>::Span(Data + Begin, End - Begin)
+                : typename TermAccess<T>::Span();
+        }
+        else if constexpr (IsSplitComponent<T>)
+        {
+            using FieldType = typename FieldSpans<T>::FieldType;
+            Column* Store = Chunk.GetColumn(Arch->GetColumnIndex(GetComponent<std::remove_const_t<T>>()));
+            return FieldSpans<T>(static_cast<FieldType*>(Store->GetField(0)) + Begin, Store->GetFieldStride(),
+                End - Begin);
+        }
+        else
+        {
+            return std::span<T>(Arch->GetColumnData<std::remove_const_t<T>>(Chunk) + Begin, End - Begin);
+        }
+    }
+
+    template<typename T>
+    static void FillColumn(std::span<T> Values, const T& Value)
+    {
+        std::fill(Values.begin(), Values.end(), Value);
+    }
+
+    template<typename T>
+    static void FillColumn(FieldSpans<T> Fields, const T& Value)
+    {
+        typename FieldSpans<T>::FieldType FieldValues[FieldSpans<T>::FieldCount];
+        memcpy(FieldValues, &Value, sizeof(T));
+        for (size_t Field = 0; Field < FieldSpans<T>::FieldCount; Field++)
+        {
+            std::fill(Fields[Field].begin(), Fields[Field].end(), FieldValues[Field]);
+        }
+    }
+
+    template<typename Func, typename... Ts>
+    static void RunColumns(const Func& Handler, World* Wrld, const EntityID* IDs, size_t Count,
+        const SparseFilter* Filter, Ts... Columns)
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            if (Filter != nullptr && !Wrld->PassesSparseFilter(IDs[i], *Filter))
+            {
+                continue;
+            }
+            if constexpr (std::is_invocable_v<const Func&, World*, EntityID, decltype(GetRow(Columns, IDs, 0))...>)
+            {
+                Handler(Wrld, IDs[i], GetRow(Columns, IDs, i)...);
+            }
+            else
+            {
+                Handler(GetRow(Columns, IDs, i)...);
+            }
+        }
+    }
+
+private:
+    // Where a live entity is stored. Arch is null while the slot is free
+    struct EntitySlot
+    {
+        Archetype* Arch = nullptr;
+        size_t Row = 0;
+        uint32_t Generation = 0;
+        // When the entity entered its current archetype
+        ChangeTick PlacedTick = 0;
+    };
+    EntitySlot* FindSlot(const EntityID& Entity);
+    const EntitySlot* FindSlot(const EntityID& Entity) const;
+
+    std::pmr::memory_resource* Resource;
+    std::pmr::polymorphic_allocator<> Allocator;
+
     bool WorldLock = false;
-    EntityID NextEntityID = 1;
-    std::vector<Archetype*> Archetypes;
-    std::unordered_map<ArchSignature, size_t> ArchetypeLookup;
-    std::unordered_map<EntityID, size_t> EntityArchetypeLookup;
-
-    std::unordered_map<ComponentID, SetQueue*> SetQueues;
-    std::unordered_map<ComponentID, IStorage*> RemoveQueues;
-    VectorStorage<EntityID>* Graveyard;
+    std::pmr::vector<Archetype*> Archetypes;
+    std::pmr::unordered_map<ArchSignature, size_t> ArchetypeLookup;
+    size_t ChunkBytes;
+    // Next archetype Compact(Budget) visits
+    size_t CompactCursor = 1;
+    size_t CompactBudget;
+    // Inverted indexes: archetypes having a component, and queries to offer archetypes having a component. A query
+    // with All components is indexed under the rarest one, one with only Any components under each of them
+    std::pmr::vector<std::pmr::vector<Archetype*>> ArchetypesByComponent;
+    std::pmr::vector<std::pmr::vector<Query*>> QueriesByComponent;
+    // Queries with neither All nor Any components, offered every archetype
+    std::pmr::vector<Query*> UnindexedQueries;
+    std::pmr::vector<Query*> Queries;
+    // Indexed by component ID, null for table components and sparse ones never set
+    std::pmr::vector<SparseSet*> SparsePools;
+    // The pools that exist, so deleting an entity does not walk every component ID
+    std::pmr::vector<SparseSet*> SparsePoolList;
+    // Indexed by entity index, the pairs this world holds targeting an entity of that index
+    std::pmr::vector<std::pmr::vector<ComponentID>> PairsByTarget;
+    // Pairs whose target was deleted, released by ReleaseDeadPairs
+    std::pmr::vector<ComponentID> DeadPairs;
+    // Hierarchy order of the archetypes ForEachInHierarchy visited for one relation and set of components
+    struct HierarchyOrder
+    {
+        ComponentID Relation;
+        ArchSignature Signature;
+        uint64_t Version;
+        std::vector<Archetype*> Ordered;
+    };
+    std::vector<HierarchyOrder> HierarchyOrders;
+    // Moves on whenever the order may change: an archetype is made or dropped, or a pair target changes archetype
+    // or is deleted. Entities moving between existing archetypes leave the depth of every archetype as it was
+    uint64_t HierarchyVersion = 1;
+
+    // Indexed by entity index. Slots may lag behind NextSlot while entities reserved under lock are pending
+    std::pmr::vector<EntitySlot> Slots;
+    std::pmr::vector<uint32_t> FreeSlots;
+    std::atomic<uint32_t> NextSlot = 1;
+
+    // Last tick handed out, to a system run or to a change made outside of systems
+    std::atomic<ChangeTick> CurrentTick = 0;
+    bool TrackDeltas;
+    std::pmr::vector<std::pair<EntityID, ChangeTick>> DeletedLog;
+
+    // Buffers are made on first use within a tick. Null outside of ticks
+    CommandBuffer* MainBuffer = nullptr;
+    std::pmr::vector<CommandBuffer*> SystemBuffers;
+    // One per pool thread, indexed by ThreadPool::GetCurrentThreadIndex
+    std::pmr::vector<BumpArena*> CommandArenas;
+    // Stack of submissions not applied yet, newest first
+    std::atomic<SubmittedCommands*> Submitted = nullptr;
     
     std::vector<System> Systems;
+    Scheduler Schedule;
+    bool ScheduleDirty = false;
+    ThreadPool Workers;
 };
\ No newline at end of file